@@ -0,0 +1,118 @@
+// Times the ray-sphere kernels of collision.hpp against each other and against
+// the broadphase of broadphase.hpp, and checks that they agree with the
+// scalar reference. Runs without a window or OpenGL
+//
+// Usage: collision_bench [rays] [spheres] [repetitions]
+
+#include "broadphase.hpp"
+#include "collision.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+
+static float randomFloat(float low, float high){
+  return low + (high - low) * rand() / RAND_MAX;
+}
+
+static glm::vec3 randomPoint(float extent){
+  return glm::vec3(randomFloat(-extent, extent), randomFloat(-extent, extent), randomFloat(-extent, extent));
+}
+
+int main(int argc, char* argv[]){
+  int rays = argc > 1 ? atoi(argv[1]) : 4096;
+  int spheres = argc > 2 ? atoi(argv[2]) : 256;
+  int repetitions = argc > 3 ? atoi(argv[3]) : 20;
+  if(rays < 1 || spheres < 1 || repetitions < 1){
+    fprintf(stderr, "Usage: %s [rays] [spheres] [repetitions]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // Spheres scattered in a box, rays from around it aimed at random points inside
+  srand(1);
+  SphereBatch sphereBatch;
+  for(int i = 0; i < spheres; i++){
+    addSphere(&sphereBatch, randomPoint(20.0f), randomFloat(0.2f, 1.5f));
+  }
+
+  RayBatch rayBatch;
+  for(int i = 0; i < rays; i++){
+    glm::vec3 origin = randomPoint(30.0f);
+    addRay(&rayBatch, origin, glm::normalize(randomPoint(20.0f) - origin));
+  }
+
+  std::vector<RayHit> reference;
+  intersectRays(rayBatch, sphereBatch, &reference, COLLISION_SCALAR);
+
+  int hitCount = 0;
+  for(int i = 0; i < rays; i++){
+    hitCount += reference[i].sphere >= 0;
+  }
+  printf("%d rays, %d spheres, %d hits, best of %d runs\n", rays, spheres, hitCount, repetitions);
+
+  double scalarMs = 0.0;
+  CollisionKernel kernels[] = {COLLISION_SCALAR, COLLISION_SSE, COLLISION_AVX};
+  for(int k = 0; k < 3; k++){
+    CollisionKernel kernel = kernels[k];
+    if(!collisionKernelSupported(kernel)){
+      printf("%-7s not supported\n", collisionKernelName(kernel));
+      continue;
+    }
+
+    std::vector<RayHit> hits;
+    double bestMs = 1e30;
+    for(int r = 0; r < repetitions; r++){
+      auto start = std::chrono::steady_clock::now();
+      intersectRays(rayBatch, sphereBatch, &hits, kernel);
+      auto end = std::chrono::steady_clock::now();
+      bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    int mismatches = 0;
+    for(int i = 0; i < rays; i++){
+      if(hits[i].sphere != reference[i].sphere
+	 || (hits[i].sphere >= 0 && hits[i].distance != reference[i].distance)){
+	mismatches++;
+      }
+    }
+
+    if(kernel == COLLISION_SCALAR){
+      scalarMs = bestMs;
+    }
+
+    printf("%-7s %9.3f ms  %7.3f ns per test  %5.2fx  %d mismatches\n",
+	   collisionKernelName(kernel), bestMs, 1e6 * bestMs / ((double)rays * spheres),
+	   scalarMs / bestMs, mismatches);
+  }
+
+  // The broadphase is refitted before every query, as it would be each frame
+  SphereBvh bvh = SphereBvh();
+  BroadphaseStats stats;
+  resetBroadphaseStats(&stats);
+
+  std::vector<RayHit> hits;
+  double bestMs = 1e30;
+  for(int r = 0; r < repetitions; r++){
+    auto start = std::chrono::steady_clock::now();
+    updateSphereBvh(&bvh, sphereBatch);
+    queryRays(bvh, sphereBatch, rayBatch, &hits, &stats);
+    auto end = std::chrono::steady_clock::now();
+    bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  int mismatches = 0;
+  for(int i = 0; i < rays; i++){
+    if(hits[i].sphere != reference[i].sphere
+       && !(hits[i].sphere >= 0 && hits[i].distance == reference[i].distance)){
+      mismatches++;
+    }
+  }
+
+  printf("%-7s %9.3f ms  %7.3f ns per ray   %5.2fx  %d mismatches\n",
+	 "bvh", bestMs, 1e6 * bestMs / rays, scalarMs / bestMs, mismatches);
+  printBroadphaseStats(stats, bvh);
+
+  return EXIT_SUCCESS;
+}
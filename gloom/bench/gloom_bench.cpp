@@ -0,0 +1,250 @@
+// Runs the whole renderer headless for a fixed number of frames, with a
+// scripted camera path and schedule of shots so that every run does the same
+// work, and reports the CPU and GPU time of each pass as percentiles in JSON.
+// Works on software renderers such as llvmpipe, so it can run in CI.
+// Shaders are found relative to the working directory, like gloom itself,
+// so run it from a build directory in the root of the repository
+//
+// Usage: gloom_bench [--frames N] [--warmup N] [--orbiters N] [--probe-size N]
+//                    [--burst N] [--backend auto|egl|osmesa] [--json FILE]
+//
+// The log of the program goes to stdout as usual, followed by a summary.
+// Every frame's GPU timestamps are waited for, and the run fails if any
+// were dropped all the same
+
+#include "headless.hpp"
+#include "pass_timer.hpp"
+#include "program.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+// Frames between bursts of shots
+const int burstInterval = 10;
+
+struct BenchState{
+  int warmup;
+  int burst;  // Shots per burst
+  unsigned int seed;
+  int shots;  // Fired after the warmup
+
+  PassTimer timer;
+  std::chrono::steady_clock::time_point frameStart;
+  bool started;
+  std::vector<double> frameMs;
+};
+
+static BenchState bench;
+
+// Own generator, so the schedule does not depend on the C library
+static float nextRandom(){
+  bench.seed = bench.seed * 1664525u + 1013904223u;
+  return (bench.seed >> 8) / 16777216.0f;
+}
+
+static void scriptFrame(int framenum, float time, glm::mat4* view, std::vector<ScriptedShot>* shots){
+  // Later frames start where the one before ended
+  if(!bench.started){
+    bench.frameStart = std::chrono::steady_clock::now();
+    bench.started = true;
+  }
+
+  if(framenum == bench.warmup + 1){
+    resetPassTimer(&bench.timer);
+  }
+
+  // Slow orbit around the ball, bobbing up and down
+  float angle = 0.3f * time;
+  glm::vec3 eye(7.0f * sin(angle), 3.0f + sin(0.5f * time), 7.0f * cos(angle));
+  *view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  // Bursts aimed at points scattered over the front of the ball
+  if(framenum % burstInterval == 0){
+    for(int i = 0; i < bench.burst; i++){
+      glm::vec3 target(nextRandom() - 0.5f, nextRandom() - 0.5f, nextRandom() - 0.5f);
+      ScriptedShot shot;
+      shot.origin = eye;
+      shot.direction = glm::normalize(1.6f * target - eye);
+      shots->push_back(shot);
+    }
+    if(framenum > bench.warmup){
+      bench.shots += bench.burst;
+    }
+  }
+}
+
+// Times every frame from the end of the one before, so N measured frames
+// give N samples
+static void scriptFrameEnd(int framenum){
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if(framenum > bench.warmup){
+    std::chrono::duration<double, std::milli> elapsed = now - bench.frameStart;
+    bench.frameMs.push_back(elapsed.count());
+  }
+  bench.frameStart = now;
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction){
+  if(sorted.empty()){
+    return 0.0;
+  }
+  size_t index = (size_t)ceil(fraction * sorted.size());
+  return sorted[std::min(sorted.size(), std::max((size_t)1, index)) - 1];
+}
+
+static void writeStats(FILE* file, const char* name, std::vector<double> samples, const char* indent){
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for(unsigned int i = 0; i < samples.size(); i++){
+    sum += samples[i];
+  }
+
+  fprintf(file, "%s\"%s\": {\"samples\": %d, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+	  indent, name, (int)samples.size(), samples.empty() ? 0.0 : sum / samples.size(),
+	  percentile(samples, 0.5), percentile(samples, 0.9), percentile(samples, 0.99),
+	  samples.empty() ? 0.0 : samples.back());
+}
+
+static void writeJson(FILE* file, const ProgramSettings& settings, const HeadlessContext& context){
+  fprintf(file, "{\n");
+  fprintf(file, "  \"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+  fprintf(file, "  \"backend\": \"%s\",\n", headlessBackendName(context.backend));
+  fprintf(file, "  \"frames\": %d,\n", settings.headlessFrames - bench.warmup);
+  fprintf(file, "  \"warmup\": %d,\n", bench.warmup);
+  fprintf(file, "  \"orbiters\": %d,\n", settings.orbiterCount);
+  fprintf(file, "  \"probe_size\": %d,\n", settings.probeSize);
+  fprintf(file, "  \"shots\": %d,\n", bench.shots);
+  fprintf(file, "  \"late_gpu_frames\": %d,\n", bench.timer.late);
+  fprintf(file, "  \"unit\": \"ms\",\n");
+  writeStats(file, "frame", bench.frameMs, "  ");
+  fprintf(file, ",\n  \"passes\": {\n");
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    fprintf(file, "    \"%s\": {\n", passName((FramePass)pass));
+    writeStats(file, "cpu", bench.timer.cpuMs[pass], "      ");
+    fprintf(file, ",\n");
+    writeStats(file, "gpu", bench.timer.gpuMs[pass], "      ");
+    fprintf(file, "\n    }%s\n", pass + 1 < PASS_COUNT ? "," : "");
+  }
+  fprintf(file, "  }\n}\n");
+}
+
+static void printUsage(const char* name){
+  fprintf(stderr,
+	  "Usage: %s [options]\n"
+	  "  --frames N                    Frames measured, after the warmup\n"
+	  "  --warmup N                    Frames run first and not measured, at least 1\n"
+	  "  --orbiters N                  Number of spheres orbiting the ball\n"
+	  "  --probe-size N                Resolution of each cube map face\n"
+	  "  --burst N                     Shots fired every %d frames\n"
+	  "  --backend auto|egl|osmesa     Headless context to render with\n"
+	  "  --json FILE                   Where to write the results (gloom_bench.json)\n",
+	  name, burstInterval);
+}
+
+int main(int argc, char* argv[]){
+  ProgramSettings settings = defaultProgramSettings();
+  int frames = 600;
+  bench.warmup = 60;
+  bench.burst = 8;
+  std::string jsonFile = "gloom_bench.json";
+
+  for(int i = 1; i < argc; i++){
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if(value == NULL){
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    i++;
+
+    if(strcmp(arg, "--frames") == 0){
+      frames = atoi(value);
+    }else if(strcmp(arg, "--warmup") == 0){
+      bench.warmup = atoi(value);
+    }else if(strcmp(arg, "--orbiters") == 0){
+      settings.orbiterCount = atoi(value);
+    }else if(strcmp(arg, "--probe-size") == 0){
+      settings.probeSize = atoi(value);
+    }else if(strcmp(arg, "--burst") == 0){
+      bench.burst = atoi(value);
+    }else if(strcmp(arg, "--backend") == 0){
+      if(strcmp(value, "auto") == 0){
+	settings.headlessBackend = HEADLESS_AUTO;
+      }else if(strcmp(value, "egl") == 0){
+	settings.headlessBackend = HEADLESS_EGL;
+      }else if(strcmp(value, "osmesa") == 0){
+	settings.headlessBackend = HEADLESS_OSMESA;
+      }else{
+	printUsage(argv[0]);
+	return EXIT_FAILURE;
+      }
+    }else if(strcmp(arg, "--json") == 0){
+      jsonFile = value;
+    }else{
+      printUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  // The pass timer never samples the first frame, which would leave the
+  // passes a sample short of the frame times
+  if(frames < 1 || bench.warmup < 1 || settings.orbiterCount < 0 || settings.probeSize < 1 || bench.burst < 0){
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  HeadlessContext context;
+  if(!createHeadlessContext(&context, settings.headlessBackend)){
+    fprintf(stderr, "Could not create a headless OpenGL context with %s\n",
+	    headlessBackendName(settings.headlessBackend));
+    return EXIT_FAILURE;
+  }
+  printf("%s: %s, headless %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER),
+	 headlessBackendName(context.backend));
+
+  bench.seed = 1;
+  bench.shots = 0;
+  bench.started = false;
+
+  ProgramScript script;
+  script.frame = scriptFrame;
+  script.frameEnd = scriptFrameEnd;
+  script.timer = &bench.timer;
+  settings.script = &script;
+  settings.headlessFrames = bench.warmup + frames;
+
+  runProgram(nullptr, settings);
+
+  FILE* file = fopen(jsonFile.c_str(), "w");
+  if(file == NULL){
+    fprintf(stderr, "Could not open %s\n", jsonFile.c_str());
+    return EXIT_FAILURE;
+  }
+  writeJson(file, settings, context);
+  fclose(file);
+
+  printf("\n%d frames after %d of warmup, %d shots, written to %s\n",
+	 frames, bench.warmup, bench.shots, jsonFile.c_str());
+  printPassTimer(bench.timer);
+
+  // Percentiles over a subset of the frames would look better than they are
+  bool complete = bench.timer.late == 0;
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    complete = complete && bench.timer.gpuMs[pass].size() == bench.timer.cpuMs[pass].size();
+  }
+  destroyHeadlessContext(&context);
+  if(!complete){
+    fprintf(stderr, "GPU timestamps of %d frames were dropped, the GPU times are incomplete\n",
+	    bench.timer.late);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -3,18 +3,15 @@
 layout(location = 0) in vec2 coord;
 layout(location = 1) in vec3 out_normal;
 layout(location = 2) in vec3 out_position;
+layout(location = 3) in vec3 out_light_position;
 
 out vec4 color;
 
-uniform vec3 lightPosition;
-uniform mat4 view;
-
 layout(binding = 0) uniform sampler2D sampler;
 
 void main()
 {
-        vec3 lightPosition2 = (view * vec4(lightPosition, 1)).xyz;
-        vec3 dp = out_position - lightPosition2;
+        vec3 dp = out_position - out_light_position;
         float l = length(dp);
 
         vec3 norm_normal = normalize(out_normal);
@@ -3,19 +3,46 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 tex;
 layout(location = 2) in vec3 normal;
+layout(location = 5) in mat4 instance_model; // Per instance, occupies locations 5-8
+layout(location = 9) in uint object_index;    // Per instance, index into objects
 
 layout(location = 0) out vec2 coord;
 layout(location = 1) out vec3 out_normal;
 layout(location = 2) out vec3 out_position;
+layout(location = 3) out vec3 out_light_position;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool instanced; // Take the model matrix from instance_model instead of model
+uniform bool indirect;  // Take the model matrix from objects[object_index]
+
+// Per-object data for indirect draws, see ObjectData in indirect.hpp
+struct ObjectData
+{
+    mat4 model;
+    int faceMask;
+};
+
+layout(std430, binding = 2) readonly buffer Objects
+{
+    ObjectData objects[];
+};
+
+// Per-view state shared by all programs, see FrameUniforms in frame_uniforms.hpp
+layout(std140, binding = 0) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightPosition;
+};
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    mat4 object_model = indirect ? objects[object_index].model
+        : instanced ? instance_model : model;
+
+    gl_Position = projection * view * object_model * vec4(position, 1.0f);
     coord = tex;
-    out_normal = ( view * model * vec4(normal, 0.0)).xyz;
-    out_position = (view * model * vec4(position, 1.0)).xyz;
-}
\ No newline at end of file
+    out_normal = ( view * object_model * vec4(normal, 0.0)).xyz;
+    out_position = (view * object_model * vec4(position, 1.0)).xyz;
+    out_light_position = (view * vec4(lightPosition, 1)).xyz;
+}
@@ -0,0 +1,45 @@
+#version 450 core
+
+// Vertex stage of the single-pass cube map program. Positions are only
+// taken to world space here, the geometry shader applies the face views.
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec2 tex;
+layout(location = 2) in vec3 normal;
+layout(location = 5) in mat4 instance_model; // Per instance, occupies locations 5-8
+layout(location = 9) in uint object_index;    // Per instance, index into objects
+
+layout(location = 0) out vec2 world_coord;
+layout(location = 1) out vec3 world_normal;
+layout(location = 2) out vec3 world_position;
+layout(location = 3) flat out int face_mask;
+
+uniform mat4 model;
+uniform bool instanced; // Take the model matrix from instance_model instead of model
+uniform bool indirect;  // Take model matrix and face mask from objects[object_index]
+uniform int faceMask;   // Bit i is set if face i can see the object
+
+// Per-object data for indirect draws, see ObjectData in indirect.hpp
+struct ObjectData
+{
+    mat4 model;
+    int faceMask;
+};
+
+layout(std430, binding = 2) readonly buffer Objects
+{
+    ObjectData objects[];
+};
+
+void main()
+{
+    mat4 object_model = indirect ? objects[object_index].model
+        : instanced ? instance_model : model;
+    face_mask = indirect ? objects[object_index].faceMask : faceMask;
+
+    vec4 world = object_model * vec4(position, 1.0f);
+    gl_Position = world;
+    world_coord = tex;
+    world_normal = (object_model * vec4(normal, 0.0)).xyz;
+    world_position = world.xyz;
+}
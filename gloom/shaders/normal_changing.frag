@@ -1,19 +1,23 @@
 #version 450 core
 
-layout(location = 0) in vec2 texdir;
-layout(location = 1) in vec3 dist;
-
 layout(location = 0) out vec4 col;
 
-uniform float texture_size;
+uniform vec3 collisionPoint;
 
-layout(location = 0) uniform sampler2D original_texture;
+layout(binding = 0) uniform sampler2D original_texture;
+layout(binding = 1) uniform sampler2DArray surface; // See sphere_surface.hpp
 
 void main(){
   const float maxdist = 0.3;
 
-  vec2 coord = gl_FragCoord.xy/texture_size;
-  vec4 sampled_value = texture(original_texture, coord);
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  vec4 sampled_value = texelFetch(original_texture, texel, 0);
+
+  // The surface may be coarser than the map, so it is interpolated
+  vec2 uv = gl_FragCoord.xy / vec2(textureSize(original_texture, 0));
+  vec3 dist = texture(surface, vec3(uv, 0)).xyz - collisionPoint;
+  vec2 texdir = vec2(dot(dist, normalize(texture(surface, vec3(uv, 1)).xyz)),
+		     dot(dist, normalize(texture(surface, vec3(uv, 2)).xyz)));
   
   if(length(dist) < maxdist){
     vec3 orig_val = normalize(sampled_value.xyz * 2 - 1);
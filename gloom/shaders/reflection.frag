@@ -8,16 +8,71 @@ layout(location = 3) in mat3 TBN;
 
 out vec4 color;
 
-uniform vec3 lightPosition;
-uniform mat4 view;
+// Per-view state shared by all programs, see FrameUniforms in frame_uniforms.hpp
+layout(std140, binding = 0) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightPosition;
+};
+
+// When set, dented regions sample blurred levels of the probe instead of
+// being mixed towards grey
+uniform bool prefilteredRoughness;
+uniform float probeMaxLod;
 
 layout(binding = 0) uniform samplerCube sampler;
 layout(binding = 1) uniform sampler2D normalMap;
 
+// Sparse tiled normal map, see dent_tiles.hpp. Used instead of normalMap when set
+uniform bool tiledNormals;
+layout(binding = 2) uniform isampler2D normalPages;
+layout(binding = 3) uniform sampler2DArray normalTiles[4]; // dentTileArrays
+
+// One texel of the tiled map, x wraps around the u = 0 seam
+vec3 tiledNormalTexel(ivec2 texel, int tileSize, ivec2 size){
+  texel.x = (texel.x % size.x + size.x) % size.x;
+  texel.y = clamp(texel.y, 0, size.y - 1);
+
+  int page = texelFetch(normalPages, texel / tileSize, 0).r;
+  if(page < 0){
+    return vec3(128, 128, 255) / 255.; // Flat, see flatNormalTexel in dents.hpp
+  }
+
+  // Samplers may only be indexed by constants here
+  ivec3 coord = ivec3(texel % tileSize, page & 0xffff);
+  switch(page >> 16){
+  case 0:
+    return texelFetch(normalTiles[0], coord, 0).xyz;
+  case 1:
+    return texelFetch(normalTiles[1], coord, 0).xyz;
+  case 2:
+    return texelFetch(normalTiles[2], coord, 0).xyz;
+  default:
+    return texelFetch(normalTiles[3], coord, 0).xyz;
+  }
+}
+
+// Bilinear filtering by hand, as neighbouring texels may lie in different tiles
+vec3 tiledNormal(vec2 coord){
+  int tileSize = textureSize(normalTiles[0], 0).x;
+  ivec2 size = textureSize(normalPages, 0) * tileSize;
+
+  vec2 position = coord * vec2(size) - 0.5;
+  ivec2 texel = ivec2(floor(position));
+  vec2 f = fract(position);
+
+  return mix(mix(tiledNormalTexel(texel, tileSize, size),
+		 tiledNormalTexel(texel + ivec2(1, 0), tileSize, size), f.x),
+	     mix(tiledNormalTexel(texel + ivec2(0, 1), tileSize, size),
+		 tiledNormalTexel(texel + ivec2(1, 1), tileSize, size), f.x), f.y);
+}
+
 
 void main()
 {
-  vec3 sampled_normal = texture(normalMap, uv).xyz * 2. - vec3(1.);
+  vec3 sampled = tiledNormals ? tiledNormal(uv) : texture(normalMap, uv).xyz;
+  vec3 sampled_normal = sampled * 2. - vec3(1.);
   vec3 out_normal = normalize(TBN * sampled_normal);
   
   vec3 world_cam_pos = -transpose(mat3(view)) * view[3].xyz;
@@ -34,7 +89,6 @@ void main()
   float deviation = max(0, dot(reflecvec, -normalize(rotated_position.xyz)));
   float specular_str = pow(deviation, 6);
     
-  vec4 col = texture(sampler, world_reflecvec);
 
   if(dot(vec3(0, 0, 1), sampled_normal) < .1){
     color = vec4(1.0, 0, 0, 1.0);
@@ -43,6 +97,17 @@ void main()
   
   float weighting = min(1, 0.2 + 2 * (1 -  dot(vec3(0, 0, 1), sampled_normal)));
   
+  vec4 col;
+  if(prefilteredRoughness){
+    // The dent term alone, so an undented normal samples the sharp level 0
+    float roughness = clamp((weighting - 0.2) / 0.8, 0., 1.);
+    col = textureLod(sampler, world_reflecvec, roughness * probeMaxLod);
+    // Deliberate: the blur stands in for the grey mix that fakes roughness
+    // otherwise, so only the base tint is kept
+    weighting = 0.2;
+  }else{
+    col = texture(sampler, world_reflecvec);
+  }
   
   color =
     mix(col * 0.9, vec4(0.5, 0.5, 0.5, 1.0), weighting)
@@ -3,7 +3,7 @@
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 tex;
 layout(location = 2) in vec3 normal;
-layout(location = 3) in vec3 tangent;
+layout(location = 3) in vec4 tangent; // w is the bitangent sign when packed
 layout(location = 4) in vec3 bitangent;
 
 layout(location = 0) out vec3 out_rotated_position;
@@ -12,8 +12,15 @@ layout(location = 2) out vec2 coord;
 layout(location = 3) out mat3 TBN; // Tangent, bitangent, normal
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool packedVertices; // No bitangent attribute, rebuild it from the tangent
+
+// Per-view state shared by all programs, see FrameUniforms in frame_uniforms.hpp
+layout(std140, binding = 0) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightPosition;
+};
 
 void main()
 {
@@ -23,9 +30,11 @@ void main()
     out_origin_position = (model * vec4(position, 1.0)).xyz;
     out_rotated_position = (view * model * vec4(position, 1.0)).xyz;
 
+    vec3 object_bitangent = packedVertices ? tangent.w * cross(normal, tangent.xyz) : bitangent;
+
     // NB: Assumes that tangent and bitangent are normalized
-    vec3 T = (view * model * vec4(tangent, 0.0)).xyz;
-    vec3 B = (view * model * vec4(bitangent, 0.0)).xyz;
+    vec3 T = (view * model * vec4(tangent.xyz, 0.0)).xyz;
+    vec3 B = (view * model * vec4(object_bitangent, 0.0)).xyz;
     vec3 N = normalize( (view * model * vec4(normal, 0.0)).xyz);
 
     TBN = mat3(T, B, N);
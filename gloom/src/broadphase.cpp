@@ -0,0 +1,208 @@
+#include "broadphase.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+
+static const int maxLeafSpheres = 4;
+
+static glm::vec3 sphereCenter(const SphereBatch& spheres, int i){
+  return glm::vec3(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+}
+
+static float surfaceArea(const BvhNode& node){
+  glm::vec3 size = node.boundsMax - node.boundsMin;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static void fitLeaf(BvhNode* node, const SphereBvh& bvh, const SphereBatch& spheres){
+  node->boundsMin = glm::vec3(std::numeric_limits<float>::infinity());
+  node->boundsMax = -node->boundsMin;
+  for(int i = node->first; i < node->first + node->count; i++){
+    int sphere = bvh.order[i];
+    glm::vec3 center = sphereCenter(spheres, sphere);
+    glm::vec3 extent(spheres.radius[sphere]);
+    node->boundsMin = glm::min(node->boundsMin, center - extent);
+    node->boundsMax = glm::max(node->boundsMax, center + extent);
+  }
+}
+
+// Splits order[first, first + count) at the median along the longest axis
+// of the sphere centres
+static void buildNode(SphereBvh* bvh, const SphereBatch& spheres, int index, int first, int count){
+  BvhNode& node = bvh->nodes[index];
+  node.first = first;
+  node.count = count;
+  fitLeaf(&node, *bvh, spheres);
+  if(count <= maxLeafSpheres){
+    return;
+  }
+
+  glm::vec3 centersMin(std::numeric_limits<float>::infinity());
+  glm::vec3 centersMax = -centersMin;
+  for(int i = first; i < first + count; i++){
+    glm::vec3 center = sphereCenter(spheres, bvh->order[i]);
+    centersMin = glm::min(centersMin, center);
+    centersMax = glm::max(centersMax, center);
+  }
+
+  glm::vec3 size = centersMax - centersMin;
+  int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+  int half = count / 2;
+  std::nth_element(bvh->order.begin() + first, bvh->order.begin() + first + half,
+		   bvh->order.begin() + first + count,
+		   [&](int a, int b){ return sphereCenter(spheres, a)[axis] < sphereCenter(spheres, b)[axis]; });
+
+  int child = bvh->nodes.size();
+  bvh->nodes.resize(child + 2);
+  bvh->nodes[index].first = child;
+  bvh->nodes[index].count = 0;
+
+  buildNode(bvh, spheres, child, first, half);
+  buildNode(bvh, spheres, child + 1, first + half, count - half);
+}
+
+static float totalArea(const SphereBvh& bvh){
+  float area = 0.0f;
+  for(unsigned int i = 0; i < bvh.nodes.size(); i++){
+    area += surfaceArea(bvh.nodes[i]);
+  }
+  return area;
+}
+
+void buildSphereBvh(SphereBvh* bvh, const SphereBatch& spheres){
+  int count = sphereCount(spheres);
+  bvh->order.resize(count);
+  for(int i = 0; i < count; i++){
+    bvh->order[i] = i;
+  }
+
+  // An empty tree has no root, as a leaf without spheres would read as an inner node
+  bvh->nodes.clear();
+  if(count > 0){
+    bvh->nodes.reserve(2 * count);
+    bvh->nodes.resize(1);
+    buildNode(bvh, spheres, 0, 0, count);
+  }
+
+  bvh->builtArea = totalArea(*bvh);
+  bvh->rebuilds++;
+}
+
+void updateSphereBvh(SphereBvh* bvh, const SphereBatch& spheres){
+  if((int)bvh->order.size() != sphereCount(spheres)){
+    buildSphereBvh(bvh, spheres);
+    return;
+  }
+
+  // Children come after their parents, so going backwards refits bottom up
+  for(int i = bvh->nodes.size() - 1; i >= 0; i--){
+    BvhNode& node = bvh->nodes[i];
+    if(node.count > 0){
+      fitLeaf(&node, *bvh, spheres);
+    }else{
+      const BvhNode& left = bvh->nodes[node.first];
+      const BvhNode& right = bvh->nodes[node.first + 1];
+      node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+      node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+    }
+  }
+
+  if(totalArea(*bvh) > 2.0f * bvh->builtArea){
+    buildSphereBvh(bvh, spheres);
+  }
+}
+
+// Slab test, entry is where the ray enters the box
+static bool rayHitsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const BvhNode& node,
+		       float maxDistance, float* entry){
+  glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+  glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+  glm::vec3 near = glm::min(t0, t1);
+  glm::vec3 far = glm::max(t0, t1);
+
+  *entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+  float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+  return *entry <= exit;
+}
+
+void queryRays(const SphereBvh& bvh, const SphereBatch& spheres, const RayBatch& rays,
+	       std::vector<RayHit>* hits, BroadphaseStats* stats){
+  int count = rayCount(rays);
+  hits->resize(count);
+
+  std::vector<int> stack;
+  for(int ray = 0; ray < count; ray++){
+    glm::vec3 origin(rays.originX[ray], rays.originY[ray], rays.originZ[ray]);
+    glm::vec3 direction(rays.directionX[ray], rays.directionY[ray], rays.directionZ[ray]);
+    glm::vec3 inverseDirection = 1.0f / direction;
+
+    RayHit& hit = (*hits)[ray];
+    hit.sphere = -1;
+    hit.distance = std::numeric_limits<float>::infinity();
+    stats->queries++;
+
+    float entry;
+    if(bvh.nodes.empty() || !rayHitsBox(origin, inverseDirection, bvh.nodes[0], hit.distance, &entry)){
+      continue;
+    }
+
+    stack.clear();
+    stack.push_back(0);
+    while(!stack.empty()){
+      const BvhNode& node = bvh.nodes[stack.back()];
+      stack.pop_back();
+      stats->nodesVisited++;
+
+      if(node.count > 0){
+	for(int i = node.first; i < node.first + node.count; i++){
+	  int sphere = bvh.order[i];
+	  float t = raySphereDistance(origin, direction, sphereCenter(spheres, sphere), spheres.radius[sphere]);
+	  stats->candidatesTested++;
+	  if(t >= 0.0f && t < hit.distance){
+	    hit.sphere = sphere;
+	    hit.distance = t;
+	  }
+	}
+	continue;
+      }
+
+      // Nearer child on top of the stack, so hits found there can prune the other
+      float leftEntry, rightEntry;
+      bool left = rayHitsBox(origin, inverseDirection, bvh.nodes[node.first], hit.distance, &leftEntry);
+      bool right = rayHitsBox(origin, inverseDirection, bvh.nodes[node.first + 1], hit.distance, &rightEntry);
+      if(left && right){
+	bool leftFirst = leftEntry <= rightEntry;
+	stack.push_back(leftFirst ? node.first + 1 : node.first);
+	stack.push_back(leftFirst ? node.first : node.first + 1);
+      }else if(left){
+	stack.push_back(node.first);
+      }else if(right){
+	stack.push_back(node.first + 1);
+      }
+    }
+
+    if(hit.sphere >= 0){
+      stats->hits++;
+    }
+  }
+
+  completeRayHits(rays, spheres, hits);
+}
+
+void resetBroadphaseStats(BroadphaseStats* stats){
+  stats->queries = 0;
+  stats->nodesVisited = 0;
+  stats->candidatesTested = 0;
+  stats->hits = 0;
+}
+
+void printBroadphaseStats(const BroadphaseStats& stats, const SphereBvh& bvh){
+  double queries = std::max(1L, stats.queries);
+  printf("Broadphase: %ld rays, %ld hits, %.1f nodes visited and %.1f spheres tested per ray"
+	 " (%d spheres, %d nodes, %d rebuilds)\n",
+	 stats.queries, stats.hits, stats.nodesVisited / queries, stats.candidatesTested / queries,
+	 (int)bvh.order.size(), (int)bvh.nodes.size(), bvh.rebuilds);
+}
@@ -0,0 +1,55 @@
+#ifndef BROADPHASE_HPP
+#define BROADPHASE_HPP
+#pragma once
+
+// Bounding volume hierarchy over the spheres of a SphereBatch, so rays can be
+// tested against many moving spheres without visiting all of them. The tree
+// is refitted to the new sphere positions every frame, and only rebuilt when
+// refitting has made it too loose
+
+#include "collision.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+struct BvhNode{
+  glm::vec3 boundsMin, boundsMax;
+  int first; // Inner nodes: index of the first child, the second follows it.
+             // Leaves: first entry in SphereBvh::order
+  int count; // Spheres in a leaf, 0 for inner nodes
+};
+
+struct SphereBvh{
+  std::vector<BvhNode> nodes; // Children always come after their parent
+  std::vector<int> order;     // Sphere indices, each leaf covers a range
+  float builtArea;            // Summed node surface area when last built
+  int rebuilds;
+};
+
+// Work done by ray queries, for profiling
+struct BroadphaseStats{
+  long queries;
+  long nodesVisited;
+  long candidatesTested;
+  long hits;
+};
+
+
+void buildSphereBvh(SphereBvh* bvh, const SphereBatch& spheres);
+
+// Moves the bounds to the current sphere positions. Rebuilds instead if the
+// number of spheres changed or the tree has become twice as loose as when built
+void updateSphereBvh(SphereBvh* bvh, const SphereBatch& spheres);
+
+// Same results as intersectRays, visiting only the nodes each ray passes through
+void queryRays(const SphereBvh& bvh, const SphereBatch& spheres, const RayBatch& rays,
+	       std::vector<RayHit>* hits, BroadphaseStats* stats);
+
+void resetBroadphaseStats(BroadphaseStats* stats);
+
+void printBroadphaseStats(const BroadphaseStats& stats, const SphereBvh& bvh);
+
+
+#endif
@@ -60,6 +60,11 @@ int getMovementZ(GLFWwindow* window){
 float yaw = -M_PI/4, pitch = -M_PI/5;
 glm::vec4 translation(-5, 5, 5, 0);
 
+static glm::mat4 cameraRotation(){
+  return glm::rotate(glm::mat4(), yaw, glm::vec3(0, 1, 0))
+    * glm::rotate(glm::mat4(), pitch, glm::vec3(1, 0, 0));
+}
+
 glm::mat4 updateCameraTransform(GLFWwindow* window){
   const float turnSpeed = 0.01;
   const float moveSpeed = 0.1;
@@ -67,12 +72,16 @@ glm::mat4 updateCameraTransform(GLFWwindow* window){
   pitch = std::max(-1.5f, std::min(1.5f, pitch + turnSpeed*getUpTurn(window)));
   yaw = yaw - turnSpeed * getRightTurn(window);
 
-  glm::mat4 rotation = glm::rotate(glm::mat4(), yaw, glm::vec3(0, 1, 0))
-    * glm::rotate(glm::mat4(), pitch, glm::vec3(1, 0, 0));
+  glm::mat4 rotation = cameraRotation();
 	
   translation += moveSpeed * getMovementX(window) * (rotation * glm::vec4(1, 0, 0, 0));
   translation -= moveSpeed * getMovementZ(window) * (rotation * glm::vec4(0, 0, 1, 0));
 
+  return cameraTransform();
+}
+
+glm::mat4 cameraTransform(){
+  glm::mat4 rotation = cameraRotation();
   glm::mat4 view = glm::mat4();
 
   view = glm::translate(view, glm::vec3(translation * rotation));
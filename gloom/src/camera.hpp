@@ -19,3 +19,6 @@ public:
 };
 
 glm::mat4 updateCameraTransform(GLFWwindow* window);
+
+// The view as it is, without any input
+glm::mat4 cameraTransform();
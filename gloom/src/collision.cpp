@@ -0,0 +1,302 @@
+#include "collision.hpp"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLLISION_HAS_SSE 1
+#include <emmintrin.h>
+#endif
+
+// With GCC and Clang the AVX kernel is always compiled in, and only run if
+// the CPU supports it. Other compilers need AVX enabled for the whole build
+#if defined(COLLISION_HAS_SSE) && defined(__GNUC__)
+#define COLLISION_HAS_AVX 1
+#define COLLISION_AVX_TARGET __attribute__((target("avx")))
+#include <immintrin.h>
+#elif defined(__AVX__)
+#define COLLISION_HAS_AVX 1
+#define COLLISION_AVX_TARGET
+#include <immintrin.h>
+#endif
+
+
+void addRay(RayBatch* rays, const glm::vec3& origin, const glm::vec3& direction){
+  rays->originX.push_back(origin.x);
+  rays->originY.push_back(origin.y);
+  rays->originZ.push_back(origin.z);
+  rays->directionX.push_back(direction.x);
+  rays->directionY.push_back(direction.y);
+  rays->directionZ.push_back(direction.z);
+}
+
+void clearRays(RayBatch* rays){
+  rays->originX.clear();
+  rays->originY.clear();
+  rays->originZ.clear();
+  rays->directionX.clear();
+  rays->directionY.clear();
+  rays->directionZ.clear();
+}
+
+int rayCount(const RayBatch& rays){
+  return rays.originX.size();
+}
+
+void addSphere(SphereBatch* spheres, const glm::vec3& center, float radius){
+  spheres->centerX.push_back(center.x);
+  spheres->centerY.push_back(center.y);
+  spheres->centerZ.push_back(center.z);
+  spheres->radius.push_back(radius);
+}
+
+void clearSpheres(SphereBatch* spheres){
+  spheres->centerX.clear();
+  spheres->centerY.clear();
+  spheres->centerZ.clear();
+  spheres->radius.clear();
+}
+
+int sphereCount(const SphereBatch& spheres){
+  return spheres.centerX.size();
+}
+
+bool collisionKernelSupported(CollisionKernel kernel){
+  switch(kernel){
+  case COLLISION_SCALAR:
+    return true;
+  case COLLISION_SSE:
+#ifdef COLLISION_HAS_SSE
+    return true;
+#else
+    return false;
+#endif
+  case COLLISION_AVX:
+#if defined(COLLISION_HAS_AVX) && defined(__GNUC__)
+    return __builtin_cpu_supports("avx");
+#elif defined(COLLISION_HAS_AVX)
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+CollisionKernel bestCollisionKernel(){
+  if(collisionKernelSupported(COLLISION_AVX)){
+    return COLLISION_AVX;
+  }
+  if(collisionKernelSupported(COLLISION_SSE)){
+    return COLLISION_SSE;
+  }
+  return COLLISION_SCALAR;
+}
+
+const char* collisionKernelName(CollisionKernel kernel){
+  switch(kernel){
+  case COLLISION_SCALAR: return "scalar";
+  case COLLISION_SSE:    return "sse";
+  case COLLISION_AVX:    return "avx";
+  }
+  return "unknown";
+}
+
+// With a normalized direction and oc = origin - center, the ray hits at
+// t = -b - sqrt(b^2 - c), where b = dot(oc, direction) and
+// c = dot(oc, oc) - radius^2. The kernels below evaluate exactly these
+// expressions in the same order, so they agree with this one bit for bit
+float raySphereDistance(const glm::vec3& origin, const glm::vec3& direction,
+			const glm::vec3& center, float radius){
+  float ocx = origin.x - center.x;
+  float ocy = origin.y - center.y;
+  float ocz = origin.z - center.z;
+
+  float b = ocx * direction.x + ocy * direction.y + ocz * direction.z;
+  float c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+  float disc = b * b - c;
+  if(disc < 0.0f){
+    return -1.0f;
+  }
+
+  return -b - sqrtf(disc);
+}
+
+static void nearestSphereScalar(const RayBatch& rays, const SphereBatch& spheres, int ray, RayHit* hit){
+  glm::vec3 origin(rays.originX[ray], rays.originY[ray], rays.originZ[ray]);
+  glm::vec3 direction(rays.directionX[ray], rays.directionY[ray], rays.directionZ[ray]);
+
+  hit->sphere = -1;
+  hit->distance = std::numeric_limits<float>::infinity();
+
+  int count = sphereCount(spheres);
+  for(int i = 0; i < count; i++){
+    glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+    float t = raySphereDistance(origin, direction, center, spheres.radius[i]);
+    if(t >= 0.0f && t < hit->distance){
+      hit->sphere = i;
+      hit->distance = t;
+    }
+  }
+}
+
+#ifdef COLLISION_HAS_SSE
+// Rays first to first + 3
+static void nearestSpheresSSE(const RayBatch& rays, const SphereBatch& spheres, int first, RayHit* hits){
+  __m128 ox = _mm_loadu_ps(&rays.originX[first]);
+  __m128 oy = _mm_loadu_ps(&rays.originY[first]);
+  __m128 oz = _mm_loadu_ps(&rays.originZ[first]);
+  __m128 dx = _mm_loadu_ps(&rays.directionX[first]);
+  __m128 dy = _mm_loadu_ps(&rays.directionY[first]);
+  __m128 dz = _mm_loadu_ps(&rays.directionZ[first]);
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 best = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  __m128 bestSphere = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+  int count = sphereCount(spheres);
+  for(int i = 0; i < count; i++){
+    __m128 ocx = _mm_sub_ps(ox, _mm_set1_ps(spheres.centerX[i]));
+    __m128 ocy = _mm_sub_ps(oy, _mm_set1_ps(spheres.centerY[i]));
+    __m128 ocz = _mm_sub_ps(oz, _mm_set1_ps(spheres.centerZ[i]));
+    float r = spheres.radius[i];
+
+    __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+    __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)),
+				     _mm_mul_ps(ocz, ocz)),
+			  _mm_set1_ps(r * r));
+    __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+
+    // Most rays miss most spheres, skip the square root when all of them do
+    __m128 touching = _mm_cmpge_ps(disc, zero);
+    if(_mm_movemask_ps(touching) == 0){
+      continue;
+    }
+
+    __m128 t = _mm_sub_ps(_mm_xor_ps(b, sign), _mm_sqrt_ps(_mm_max_ps(disc, zero)));
+
+    __m128 hit = _mm_and_ps(_mm_and_ps(touching, _mm_cmpge_ps(t, zero)),
+			    _mm_cmplt_ps(t, best));
+    __m128 sphere = _mm_castsi128_ps(_mm_set1_epi32(i));
+    best = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, best));
+    bestSphere = _mm_or_ps(_mm_and_ps(hit, sphere), _mm_andnot_ps(hit, bestSphere));
+  }
+
+  float distances[4];
+  int indices[4];
+  _mm_storeu_ps(distances, best);
+  _mm_storeu_si128((__m128i*)indices, _mm_castps_si128(bestSphere));
+  for(int j = 0; j < 4; j++){
+    hits[first + j].sphere = indices[j];
+    hits[first + j].distance = distances[j];
+  }
+}
+#endif
+
+#ifdef COLLISION_HAS_AVX
+// Rays first to first + 7
+COLLISION_AVX_TARGET
+static void nearestSpheresAVX(const RayBatch& rays, const SphereBatch& spheres, int first, RayHit* hits){
+  __m256 ox = _mm256_loadu_ps(&rays.originX[first]);
+  __m256 oy = _mm256_loadu_ps(&rays.originY[first]);
+  __m256 oz = _mm256_loadu_ps(&rays.originZ[first]);
+  __m256 dx = _mm256_loadu_ps(&rays.directionX[first]);
+  __m256 dy = _mm256_loadu_ps(&rays.directionY[first]);
+  __m256 dz = _mm256_loadu_ps(&rays.directionZ[first]);
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 best = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  __m256 bestSphere = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+  int count = sphereCount(spheres);
+  for(int i = 0; i < count; i++){
+    __m256 ocx = _mm256_sub_ps(ox, _mm256_set1_ps(spheres.centerX[i]));
+    __m256 ocy = _mm256_sub_ps(oy, _mm256_set1_ps(spheres.centerY[i]));
+    __m256 ocz = _mm256_sub_ps(oz, _mm256_set1_ps(spheres.centerZ[i]));
+    float r = spheres.radius[i];
+
+    __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)),
+			     _mm256_mul_ps(ocz, dz));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+					   _mm256_mul_ps(ocz, ocz)),
+			     _mm256_set1_ps(r * r));
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), c);
+
+    __m256 touching = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+    if(_mm256_movemask_ps(touching) == 0){
+      continue;
+    }
+
+    __m256 t = _mm256_sub_ps(_mm256_xor_ps(b, sign), _mm256_sqrt_ps(_mm256_max_ps(disc, zero)));
+
+    __m256 hit = _mm256_and_ps(_mm256_and_ps(touching, _mm256_cmp_ps(t, zero, _CMP_GE_OQ)),
+			       _mm256_cmp_ps(t, best, _CMP_LT_OQ));
+    __m256 sphere = _mm256_castsi256_ps(_mm256_set1_epi32(i));
+    best = _mm256_blendv_ps(best, t, hit);
+    bestSphere = _mm256_blendv_ps(bestSphere, sphere, hit);
+  }
+
+  float distances[8];
+  int indices[8];
+  _mm256_storeu_ps(distances, best);
+  _mm256_storeu_si256((__m256i*)indices, _mm256_castps_si256(bestSphere));
+  for(int j = 0; j < 8; j++){
+    hits[first + j].sphere = indices[j];
+    hits[first + j].distance = distances[j];
+  }
+}
+#endif
+
+static void completeRayHit(const RayBatch& rays, const SphereBatch& spheres, int ray, RayHit* hit){
+  if(hit->sphere < 0){
+    return;
+  }
+
+  glm::vec3 origin(rays.originX[ray], rays.originY[ray], rays.originZ[ray]);
+  glm::vec3 direction(rays.directionX[ray], rays.directionY[ray], rays.directionZ[ray]);
+  hit->point = origin + hit->distance * direction;
+
+  int i = hit->sphere;
+  glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+  glm::vec3 local = (hit->point - center) / spheres.radius[i];
+
+  float u = atan2f(local.x, local.z) / (2 * M_PI);
+  hit->uv.x = u < 0.0f ? u + 1.0f : u;
+  hit->uv.y = (asinf(glm::clamp(local.y, -1.0f, 1.0f)) + M_PI / 2) / M_PI;
+}
+
+void completeRayHits(const RayBatch& rays, const SphereBatch& spheres, std::vector<RayHit>* hits){
+  for(unsigned int i = 0; i < hits->size(); i++){
+    completeRayHit(rays, spheres, i, &(*hits)[i]);
+  }
+}
+
+void intersectRays(const RayBatch& rays, const SphereBatch& spheres, std::vector<RayHit>* hits,
+		   CollisionKernel kernel){
+  int count = rayCount(rays);
+  hits->resize(count);
+  RayHit* out = hits->data();
+
+  int first = 0;
+#ifdef COLLISION_HAS_AVX
+  if(kernel == COLLISION_AVX && collisionKernelSupported(COLLISION_AVX)){
+    for(; first + 8 <= count; first += 8){
+      nearestSpheresAVX(rays, spheres, first, out);
+    }
+  }
+#endif
+#ifdef COLLISION_HAS_SSE
+  if(kernel != COLLISION_SCALAR){
+    for(; first + 4 <= count; first += 4){
+      nearestSpheresSSE(rays, spheres, first, out);
+    }
+  }
+#endif
+  for(; first < count; first++){
+    nearestSphereScalar(rays, spheres, first, &out[first]);
+  }
+
+  completeRayHits(rays, spheres, hits);
+}
@@ -0,0 +1,75 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+#pragma once
+
+// Batched ray-sphere intersection on the CPU. Rays and spheres are stored as
+// structures of arrays so the SSE and AVX kernels can test four or eight
+// rays against one sphere at a time. No OpenGL is involved
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+// Directions must be normalized
+struct RayBatch{
+  std::vector<float> originX, originY, originZ;
+  std::vector<float> directionX, directionY, directionZ;
+};
+
+struct SphereBatch{
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<float> radius;
+};
+
+// Nearest hit of one ray. sphere is -1 if the ray hit nothing, in which
+// case the other fields are undefined
+struct RayHit{
+  int sphere;
+  float distance;
+  glm::vec3 point;
+  glm::vec2 uv; // Spherical, in the layout of createSphereObject
+};
+
+enum CollisionKernel{
+  COLLISION_SCALAR,
+  COLLISION_SSE,
+  COLLISION_AVX
+};
+
+
+void addRay(RayBatch* rays, const glm::vec3& origin, const glm::vec3& direction);
+
+void clearRays(RayBatch* rays);
+
+int rayCount(const RayBatch& rays);
+
+void addSphere(SphereBatch* spheres, const glm::vec3& center, float radius);
+
+void clearSpheres(SphereBatch* spheres);
+
+int sphereCount(const SphereBatch& spheres);
+
+// Whether the kernel is compiled in and supported by this CPU
+bool collisionKernelSupported(CollisionKernel kernel);
+
+CollisionKernel bestCollisionKernel();
+
+const char* collisionKernelName(CollisionKernel kernel);
+
+// Distance along the ray to where it enters the sphere, negative if it
+// misses or starts inside. Same arithmetic as the kernels
+float raySphereDistance(const glm::vec3& origin, const glm::vec3& direction,
+			const glm::vec3& center, float radius);
+
+// Fills in the point and uv of every hit from its sphere and distance
+void completeRayHits(const RayBatch& rays, const SphereBatch& spheres, std::vector<RayHit>* hits);
+
+// Finds the nearest sphere in front of every ray. Rays starting inside a
+// sphere do not hit it. All kernels give the same hits as COLLISION_SCALAR,
+// which is the reference; an unsupported kernel falls back to a slower one
+void intersectRays(const RayBatch& rays, const SphereBatch& spheres, std::vector<RayHit>* hits,
+		   CollisionKernel kernel = bestCollisionKernel());
+
+
+#endif
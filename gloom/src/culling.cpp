@@ -0,0 +1,61 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+
+Frustum extractFrustum(const glm::mat4& viewProjection){
+  // Gribb-Hartmann: planes are sums and differences of the matrix rows
+  glm::vec4 rows[4];
+  for(int i = 0; i < 4; i++){
+    rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i],
+			viewProjection[2][i], viewProjection[3][i]);
+  }
+
+  Frustum frustum;
+  for(int i = 0; i < 3; i++){
+    frustum.planes[2 * i + 0] = rows[3] + rows[i];
+    frustum.planes[2 * i + 1] = rows[3] - rows[i];
+  }
+
+  for(int i = 0; i < 6; i++){
+    frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+  }
+
+  return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere){
+  for(int i = 0; i < 6; i++){
+    if(glm::dot(glm::vec3(frustum.planes[i]), sphere.center) + frustum.planes[i].w < -sphere.radius){
+      return false;
+    }
+  }
+  return true;
+}
+
+BoundingSphere transformBoundingSphere(const glm::mat4& model, float radius){
+  float scale = std::max(glm::length(glm::vec3(model[0])),
+			 std::max(glm::length(glm::vec3(model[1])),
+				  glm::length(glm::vec3(model[2]))));
+
+  BoundingSphere sphere;
+  sphere.center = glm::vec3(model[3]);
+  sphere.radius = radius * scale;
+  return sphere;
+}
+
+void resetCullingStats(CullingStats* stats){
+  for(int i = 0; i < 6; i++){
+    stats->drawn[i] = 0;
+    stats->culled[i] = 0;
+  }
+}
+
+void printCullingStats(const CullingStats& stats){
+  printf("Probe culling (drawn/culled per face):");
+  for(int i = 0; i < 6; i++){
+    printf(" %d/%d", stats.drawn[i], stats.culled[i]);
+  }
+  printf("\n");
+}
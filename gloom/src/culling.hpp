@@ -0,0 +1,41 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+#pragma once
+
+#include "glm/glm.hpp"
+
+
+struct BoundingSphere{
+  glm::vec3 center;
+  float radius;
+};
+
+// Six planes (left, right, bottom, top, near, far) pointing inwards,
+// stored as (normal, distance)
+struct Frustum{
+  glm::vec4 planes[6];
+};
+
+// Number of objects drawn and culled for each cube map face during one frame
+struct CullingStats{
+  int drawn[6];
+  int culled[6];
+};
+
+
+// Extracts the frustum planes of a combined projection * view matrix
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+// Returns false only if the sphere is entirely outside the frustum
+bool sphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere);
+
+// Transforms an origin-centered bounding sphere into world space. The radius
+// is scaled by the largest axis scale, so the result is conservative
+BoundingSphere transformBoundingSphere(const glm::mat4& model, float radius);
+
+void resetCullingStats(CullingStats* stats);
+
+void printCullingStats(const CullingStats& stats);
+
+
+#endif
@@ -0,0 +1,223 @@
+#include "dent_journal.hpp"
+
+#include "gloom/lodepng.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+
+static const char journalMagic[4] = {'G', 'D', 'J', '1'};
+static const char snapshotMagic[4] = {'G', 'D', 'S', '1'};
+
+// Follows the magic in a snapshot, then the compressed RGBA8 texels
+struct SnapshotHeader{
+  int32_t size;
+  int32_t unused;
+  int64_t records;
+  uint64_t compressedSize;
+};
+
+static std::string snapshotPath(const DentJournal& journal){
+  return journal.path + ".snapshot";
+}
+
+void openDentJournal(DentJournal* journal, std::string path, int snapshotInterval){
+  journal->path = path;
+  journal->snapshotRecords = 0;
+  journal->snapshotInterval = snapshotInterval;
+  journal->snapshots = 0;
+  journal->lostRecords = 0;
+
+  journal->file = fopen(path.c_str(), "r+b");
+  if(journal->file == NULL){
+    journal->file = fopen(path.c_str(), "w+b");
+    if(journal->file == NULL){
+      printf("Could not create the dent journal %s\n", path.c_str());
+      exit(-1);
+    }
+    fwrite(journalMagic, 1, sizeof(journalMagic), journal->file);
+  }else{
+    char magic[sizeof(journalMagic)];
+    if(fread(magic, 1, sizeof(magic), journal->file) != sizeof(magic)
+       || memcmp(magic, journalMagic, sizeof(magic)) != 0){
+      printf("%s is not a dent journal\n", path.c_str());
+      exit(-1);
+    }
+  }
+
+  fseek(journal->file, 0, SEEK_END);
+  journal->records = (ftell(journal->file) - (long)sizeof(journalMagic)) / (long)sizeof(JournalRecord);
+
+  // Whatever a crash left of a last record is overwritten by the next one
+  fseek(journal->file, sizeof(journalMagic) + journal->records * sizeof(JournalRecord), SEEK_SET);
+}
+
+void closeDentJournal(DentJournal* journal){
+  if(journal->lostRecords > 0){
+    printf("Dent journal: %ld hits could not be written\n", journal->lostRecords);
+  }
+  fclose(journal->file);
+  journal->file = NULL;
+}
+
+// Only the first failure is printed, a full disk would fail every append
+static void reportLostRecords(DentJournal* journal, long lost){
+  if(journal->lostRecords == 0){
+    printf("Could not write to the dent journal %s, hits are being lost\n", journal->path.c_str());
+  }
+  journal->lostRecords += lost;
+}
+
+bool journalImpact(DentJournal* journal, const glm::vec3& collision){
+  JournalRecord record;
+  record.time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+  record.collision[0] = collision.x;
+  record.collision[1] = collision.y;
+  record.collision[2] = collision.z;
+  record.unused = 0.0f;
+
+  if(fwrite(&record, sizeof(record), 1, journal->file) != 1){
+    // Whatever part of the record got through is overwritten by the next one
+    clearerr(journal->file);
+    fseek(journal->file, sizeof(journalMagic) + journal->records * sizeof(JournalRecord), SEEK_SET);
+    reportLostRecords(journal, 1);
+    return false;
+  }
+  journal->records++;
+  return true;
+}
+
+bool flushDentJournal(DentJournal* journal){
+  if(fflush(journal->file) != 0){
+    clearerr(journal->file);
+    reportLostRecords(journal, 0);
+    return false;
+  }
+  return true;
+}
+
+void readDentJournal(const DentJournal& journal, long first, std::vector<glm::vec3>* collisions){
+  collisions->clear();
+  if(first >= journal.records){
+    return;
+  }
+
+  std::vector<JournalRecord> records(journal.records - first);
+  FILE* file = fopen(journal.path.c_str(), "rb");
+  if(file == NULL){
+    return;
+  }
+  fseek(file, sizeof(journalMagic) + first * sizeof(JournalRecord), SEEK_SET);
+  size_t read = fread(records.data(), sizeof(JournalRecord), records.size(), file);
+  fclose(file);
+
+  for(size_t i = 0; i < read; i++){
+    collisions->push_back(glm::vec3(records[i].collision[0], records[i].collision[1], records[i].collision[2]));
+  }
+}
+
+bool dentSnapshotDue(const DentJournal& journal){
+  return journal.records - journal.snapshotRecords >= journal.snapshotInterval;
+}
+
+void writeDentSnapshot(DentJournal* journal, const NormalMaps& maps){
+  int size = maps.size;
+  std::vector<unsigned char> texels(4 * size * size);
+  glGetTextureImage(frontNormalMap(maps), 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.size(), texels.data());
+
+  std::vector<unsigned char> compressed;
+  unsigned error = lodepng::compress(compressed, texels);
+  if(error){
+    printf("Could not compress the dent snapshot: %s\n", lodepng_error_text(error));
+    return;
+  }
+
+  // The snapshot must never cover records the journal could still lose
+  if(!flushDentJournal(journal)){
+    return;
+  }
+
+  // Written next to the old snapshot and then moved over it, so a crash
+  // leaves one of the two intact
+  std::string path = snapshotPath(*journal);
+  std::string temporary = path + ".tmp";
+  FILE* file = fopen(temporary.c_str(), "wb");
+  if(file == NULL){
+    printf("Could not write the dent snapshot %s\n", temporary.c_str());
+    return;
+  }
+
+  SnapshotHeader header;
+  header.size = size;
+  header.unused = 0;
+  header.records = journal->records;
+  header.compressedSize = compressed.size();
+
+  bool written = fwrite(snapshotMagic, 1, sizeof(snapshotMagic), file) == sizeof(snapshotMagic)
+    && fwrite(&header, sizeof(header), 1, file) == 1
+    && fwrite(compressed.data(), 1, compressed.size(), file) == compressed.size();
+  written = fclose(file) == 0 && written;
+  if(!written || rename(temporary.c_str(), path.c_str()) != 0){
+    // A short snapshot would cost a full replay, the old one is still good
+    printf("Could not write the dent snapshot %s, keeping the previous one\n", temporary.c_str());
+    remove(temporary.c_str());
+    return;
+  }
+
+  journal->snapshotRecords = journal->records;
+  journal->snapshots++;
+}
+
+bool loadDentSnapshot(DentJournal* journal, NormalMaps* maps, float sphereRadius){
+  std::string path = snapshotPath(*journal);
+  FILE* file = fopen(path.c_str(), "rb");
+  if(file == NULL){
+    return false;
+  }
+
+  char magic[sizeof(snapshotMagic)];
+  SnapshotHeader header;
+  bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+    && memcmp(magic, snapshotMagic, sizeof(magic)) == 0
+    && fread(&header, sizeof(header), 1, file) == 1;
+
+  // The header is checked before anything is allocated from it, a damaged
+  // one could ask for any amount of memory
+  long start = ftell(file);
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, start, SEEK_SET);
+
+  GLint maxSize;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  valid = valid && header.size > 0 && header.size <= maxSize && header.records >= 0
+    && start >= 0 && header.compressedSize <= (uint64_t)(length - start);
+
+  std::vector<unsigned char> compressed;
+  if(valid){
+    compressed.resize(header.compressedSize);
+    valid = fread(compressed.data(), 1, compressed.size(), file) == compressed.size();
+  }
+  fclose(file);
+
+  std::vector<unsigned char> texels;
+  valid = valid && lodepng::decompress(texels, compressed) == 0
+    && texels.size() == 4 * (size_t)header.size * header.size;
+  if(!valid){
+    printf("Ignoring the damaged dent snapshot %s, the journal is replayed instead\n", path.c_str());
+    return false;
+  }
+
+  createNormalMaps(maps, header.size, sphereRadius);
+  for(int i = 0; i < 2; i++){
+    glTextureSubImage2D(maps->textures[i], 0, 0, 0, header.size, header.size,
+			GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+  }
+
+  // A snapshot ahead of its journal means the journal was replaced by an older one
+  journal->snapshotRecords = std::min<long>(header.records, journal->records);
+  return true;
+}
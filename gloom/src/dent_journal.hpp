@@ -0,0 +1,62 @@
+#ifndef DENT_JOURNAL_HPP
+#define DENT_JOURNAL_HPP
+#pragma once
+
+#include "dents.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+// One painted hit, as stored in the journal
+struct JournalRecord{
+  double time; // Seconds since the epoch
+  float collision[3];
+  float unused; // Keeps records 8-byte aligned
+};
+
+// Keeps the dents across runs. Every painted hit is appended to the journal
+// at path, and every snapshotInterval hits the whole normal map is written
+// zlib-compressed to path + ".snapshot", along with the number of journal
+// records it covers. A run starts from the snapshot and replays the rest
+struct DentJournal{
+  std::string path;
+  FILE* file;
+
+  long records;         // In the journal
+  long snapshotRecords; // Covered by the latest snapshot
+  int snapshotInterval;
+  int snapshots;        // Written in this run
+  long lostRecords;     // Hits that could not be appended, reported once
+};
+
+
+// Opens or creates the journal, dropping a partly written last record
+void openDentJournal(DentJournal* journal, std::string path, int snapshotInterval);
+
+void closeDentJournal(DentJournal* journal);
+
+// False if the record could not be written, which leaves the journal as it was
+bool journalImpact(DentJournal* journal, const glm::vec3& collision);
+
+// Makes the records appended so far survive a crash, false if they may not
+bool flushDentJournal(DentJournal* journal);
+
+// The collisions of the records from first on
+void readDentJournal(const DentJournal& journal, long first, std::vector<glm::vec3>* collisions);
+
+bool dentSnapshotDue(const DentJournal& journal);
+
+// Reads back the front normal map, which must contain every journaled hit.
+// A snapshot that cannot be written completely leaves the previous one
+void writeDentSnapshot(DentJournal* journal, const NormalMaps& maps);
+
+// Creates the normal maps from the latest snapshot, false if there is none.
+// The maps take the size of the snapshot
+bool loadDentSnapshot(DentJournal* journal, NormalMaps* maps, float sphereRadius);
+
+
+#endif
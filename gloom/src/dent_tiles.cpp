@@ -0,0 +1,175 @@
+#include "dent_tiles.hpp"
+#include "dents.hpp"
+#include "sphere_surface.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+
+// Tile containing a texel, which may lie left of the u = 0 seam
+static int tileOf(int texel){
+  return texel >= 0 ? texel / dentTileSize : -((dentTileSize - 1 - texel) / dentTileSize);
+}
+
+// Moves the tiles of the last array in use, if any, into a new one with room
+// for layers tiles
+static void resizeTileArray(DentTiles* tiles, int array, int layers){
+  unsigned int texture;
+  glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+  glTextureStorage3D(texture, 1, GL_RGBA8, dentTileSize, dentTileSize, layers);
+  glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  int first = array * tiles->arrayLayers;
+  if(tiles->used > first){
+    glCopyImageSubData(tiles->tiles[array], GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+		       texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+		       dentTileSize, dentTileSize, tiles->used - first);
+  }
+  if(tiles->tiles[array] != 0){
+    glDeleteTextures(1, &tiles->tiles[array]);
+  }
+
+  tiles->tiles[array] = texture;
+  tiles->capacity = first + layers;
+}
+
+// Page table entry of a new flat tile. The arrays have room for every tile
+// of the map, so this cannot fail
+static int allocateTile(DentTiles* tiles){
+  int array = tiles->used / tiles->arrayLayers;
+  int layer = tiles->used % tiles->arrayLayers;
+  if(tiles->used == tiles->capacity){
+    // Grows the last array, or starts the next one when it is full
+    int layers = layer == 0 ? 16 : 2 * layer;
+    int left = (int)tiles->pages.size() - array * tiles->arrayLayers;
+    resizeTileArray(tiles, array, std::min(layers, std::min(left, tiles->arrayLayers)));
+  }
+
+  tiles->used++;
+  glClearTexSubImage(tiles->tiles[array], 0, 0, 0, layer, dentTileSize, dentTileSize, 1,
+		     GL_RGBA, GL_UNSIGNED_BYTE, flatNormalTexel);
+  return array << 16 | layer;
+}
+
+void createDentTiles(DentTiles* tiles, int size, float sphereRadius){
+  tiles->size = size;
+  tiles->tilesPerSide = size / dentTileSize;
+  tiles->pages.assign(tiles->tilesPerSide * tiles->tilesPerSide, -1);
+
+  glCreateTextures(GL_TEXTURE_2D, 1, &tiles->pageTable);
+  glTextureStorage2D(tiles->pageTable, 1, GL_R32I, tiles->tilesPerSide, tiles->tilesPerSide);
+  glTextureSubImage2D(tiles->pageTable, 0, 0, 0, tiles->tilesPerSide, tiles->tilesPerSide,
+		      GL_RED_INTEGER, GL_INT, tiles->pages.data());
+  glTextureParameteri(tiles->pageTable, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTextureParameteri(tiles->pageTable, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // The layer has 16 bits of the page table entries
+  int maxLayers;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+  tiles->arrayLayers = std::min(maxLayers, 1 << 16);
+  if(tiles->pages.size() > (size_t)dentTileArrays * tiles->arrayLayers){
+    printf("A %dx%d tiled dent map has %d tiles, more than the %d array textures of %d layers can hold\n",
+	   size, size, (int)tiles->pages.size(), dentTileArrays, tiles->arrayLayers);
+    exit(-1);
+  }
+
+  for(int i = 0; i < dentTileArrays; i++){
+    tiles->tiles[i] = 0;
+  }
+  tiles->used = 0;
+  resizeTileArray(tiles, 0, std::min(16, std::min((int)tiles->pages.size(), tiles->arrayLayers)));
+
+  tiles->surface = createSphereSurfaceTexture(dentTileSurfaceSize, sphereRadius);
+  createStreamBuffer(&tiles->tileBuffer, 64 * sizeof(glm::ivec4));
+}
+
+void printDentTiles(const DentTiles& tiles){
+  // Tile array, page table and the RGBA32F surface layers
+  double bytes = (double)tiles.capacity * dentTileSize * dentTileSize * 4
+    + tiles.pages.size() * 4.0
+    + 3.0 * dentTileSurfaceSize * dentTileSurfaceSize * 16;
+
+  printf("Dent tiles: %d of %d dented, %.1f MB for a %dx%d map, in %d arrays\n",
+	 tiles.used, (int)tiles.pages.size(), bytes / (1024 * 1024),
+	 tiles.size, tiles.size, (tiles.capacity + tiles.arrayLayers - 1) / tiles.arrayLayers);
+}
+
+void paintDentTiles(Gloom::Shader& shader, DentTiles* tiles, float sphereRadius,
+		    StreamBuffer* impactBuffer, const glm::vec3* collisions, int count){
+  int size = tiles->size;
+  int perSide = tiles->tilesPerSide;
+
+  std::vector<bool> dispatched(tiles->pages.size(), false);
+  std::vector<glm::ivec4> arrayTiles[dentTileArrays]; // Tile column and row, layer
+  std::vector<glm::vec4> impacts(count);
+  bool pagesChanged = false;
+
+  for(int i = 0; i < count; i++){
+    impacts[i] = glm::vec4(collisions[i], 0.0f); // std430 pads vec3 arrays to vec4
+
+    DentRegion region = dentRegion(collisions[i], sphereRadius, size);
+    int right = tileOf(region.x + region.width - 1);
+    int top = tileOf(region.y + region.height - 1);
+
+    for(int row = tileOf(region.y); row <= top; row++){
+      for(int tile = tileOf(region.x); tile <= right; tile++){
+	int column = (tile % perSide + perSide) % perSide;
+	int page = row * perSide + column;
+	if(dispatched[page]){
+	  continue;
+	}
+	dispatched[page] = true;
+
+	if(tiles->pages[page] < 0){
+	  tiles->pages[page] = allocateTile(tiles);
+	  pagesChanged = true;
+	}
+	arrayTiles[tiles->pages[page] >> 16].push_back(glm::ivec4(column, row, tiles->pages[page] & 0xffff, 0));
+      }
+    }
+  }
+
+  // One dispatch per array, each over its range of the tile buffer
+  std::vector<glm::ivec4> dispatchedTiles;
+  for(int i = 0; i < dentTileArrays; i++){
+    dispatchedTiles.insert(dispatchedTiles.end(), arrayTiles[i].begin(), arrayTiles[i].end());
+  }
+  if(dispatchedTiles.empty()){
+    return;
+  }
+
+  if(pagesChanged){
+    glTextureSubImage2D(tiles->pageTable, 0, 0, 0, perSide, perSide,
+			GL_RED_INTEGER, GL_INT, tiles->pages.data());
+  }
+
+  uploadStreamBuffer(impactBuffer, impacts.data(), count * sizeof(glm::vec4));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, impactStorageBinding, impactBuffer->buffer);
+  uploadStreamBuffer(&tiles->tileBuffer, dispatchedTiles.data(),
+		     dispatchedTiles.size() * sizeof(glm::ivec4));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, dentTileStorageBinding, tiles->tileBuffer.buffer);
+
+  glUseProgram(shader.get());
+  shader.setUniform("dentCount", count);
+  shader.setUniform("mapSize", size);
+
+  glBindTextureUnit(1, tiles->surface);
+
+  const Gloom::Shader::Uniform tileFirst = shader.handle("tileFirst");
+  int first = 0;
+  for(int i = 0; i < dentTileArrays; i++){
+    if(arrayTiles[i].empty()){
+      continue;
+    }
+    shader.setUniform(tileFirst, first);
+    glBindImageTexture(0, tiles->tiles[i], 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA8);
+    glDispatchCompute(dentTileSize / 8, dentTileSize / 8, arrayTiles[i].size());
+    first += arrayTiles[i].size();
+  }
+
+  // The stores are sampled, loaded by the next pass, and copied when the array grows
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+		  | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
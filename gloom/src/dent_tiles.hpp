@@ -0,0 +1,63 @@
+#ifndef DENT_TILES_HPP
+#define DENT_TILES_HPP
+#pragma once
+
+#include "gloom/shader.hpp"
+#include "resources.hpp"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+// Side length in texels of the tiles of a tiled dent map
+const int dentTileSize = 128;
+
+// The tiled map filters a coarse baked surface instead of fetching one texel
+// of it per normal map texel, which at the sizes the tiled map is meant for
+// would take more memory than the map itself
+const int dentTileSurfaceSize = 256;
+
+// Shader storage binding of the tiles dispatched by dent_tiled.comp
+const int dentTileStorageBinding = 4;
+
+// Array textures the tiles are spread over, as one array only holds
+// GL_MAX_ARRAY_TEXTURE_LAYERS tiles, 2048 on many drivers. Bound to
+// consecutive texture units for reflection.frag
+const int dentTileArrays = 4;
+
+// A very large normal map for the ball, split into tiles of which only the
+// dented ones have storage. The page table holds the array of every tile in
+// its upper 16 bits and the layer in the lower ones, or -1 while the tile is
+// still flat, in which case shaders use the constant flat normal. Dents are
+// painted in place, as every texel is only read by the invocation writing it
+struct DentTiles{
+  unsigned int tiles[dentTileArrays]; // One layer per allocated tile, 0 until needed
+  unsigned int pageTable; // tilesPerSide x tilesPerSide R32I
+  unsigned int surface;   // See sphere_surface.hpp
+  std::vector<int> pages; // What the page table holds
+
+  int size;               // Of the whole map, a multiple of dentTileSize
+  int tilesPerSide;
+  int arrayLayers;        // Of a full array, an array is only created once those before are full
+  int capacity;           // Layers of all arrays, grows when needed
+  int used;
+
+  StreamBuffer tileBuffer; // Tiles of the current dent pass
+};
+
+
+// Starts with every tile flat and a small tile array. Exits when even
+// dentTileArrays full arrays could not hold every tile of the map
+void createDentTiles(DentTiles* tiles, int size, float sphereRadius);
+
+void printDentTiles(const DentTiles& tiles);
+
+// Dents the tiles around every hit with a dispatch of dent_tiled.comp per array,
+// allocating the tiles that were still flat. The hits are uploaded to
+// impactBuffer and applied in order
+void paintDentTiles(Gloom::Shader& shader, DentTiles* tiles, float sphereRadius,
+		    StreamBuffer* impactBuffer, const glm::vec3* collisions, int count);
+
+
+#endif
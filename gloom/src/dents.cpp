@@ -0,0 +1,246 @@
+#include "dents.hpp"
+#include "resources.hpp"
+#include "sphere_surface.hpp"
+
+#include "gloom/utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+
+DentRegion dentRegion(const glm::vec3& collision, float sphereRadius, int size){
+  // Angle between the hit and the edge of the dent, seen from the centre
+  float angle = 2.0f * asin(std::min(1.0f, dentRadius / (2.0f * sphereRadius)));
+
+  glm::vec3 direction = glm::normalize(collision);
+  float latitude = asin(glm::clamp(direction.y, -1.0f, 1.0f));
+  float longitude = atan2(direction.x, direction.z);
+
+  // v runs from the bottom pole to the top, u once around from +z towards +x
+  float v0 = (latitude - angle + M_PI / 2) / M_PI;
+  float v1 = (latitude + angle + M_PI / 2) / M_PI;
+
+  DentRegion region;
+  region.y = std::max(0, (int)floor(v0 * size) - 1);
+  region.height = std::min(size, (int)ceil(v1 * size) + 1) - region.y;
+
+  // Dents covering a pole reach every longitude
+  if(cos(latitude) <= sin(angle)){
+    region.x = 0;
+    region.width = size;
+    return region;
+  }
+
+  float halfWidth = asin(sin(angle) / cos(latitude));
+  float u0 = (longitude - halfWidth) / (2 * M_PI);
+  float u1 = (longitude + halfWidth) / (2 * M_PI);
+
+  region.x = (int)floor(u0 * size) - 1;
+  region.width = std::min(size, (int)ceil(u1 * size) + 1 - region.x);
+  return region;
+}
+
+DentRegion mergeDentRegions(const DentRegion& a, const DentRegion& b, int size){
+  DentRegion region;
+  region.x = std::min(a.x, b.x);
+  region.y = std::min(a.y, b.y);
+  region.width = std::min(size, std::max(a.x + a.width, b.x + b.width) - region.x);
+  region.height = std::max(a.y + a.height, b.y + b.height) - region.y;
+  return region;
+}
+
+bool dentRegionsOverlap(const DentRegion& a, DentRegion* b, int size){
+  if(a.y >= b->y + b->height || b->y >= a.y + a.height){
+    return false;
+  }
+
+  for(int shift = -size; shift <= size; shift += size){
+    if(a.x < b->x + shift + b->width && b->x + shift < a.x + a.width){
+      b->x += shift;
+      return true;
+    }
+  }
+  return false;
+}
+
+void createNormalMaps(NormalMaps* maps, int size, float sphereRadius){
+  glCreateTextures(GL_TEXTURE_2D, 2, maps->textures);
+
+  for(int i = 0; i < 2; i++){
+    glTextureStorage2D(maps->textures[i], 1, GL_RGBA8, size, size);
+    glClearTexImage(maps->textures[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, flatNormalTexel);
+    glTextureParameteri(maps->textures[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(maps->textures[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    maps->framebuffers[i] = createFramebuffer(size, size);
+    glNamedFramebufferTexture(maps->framebuffers[i], GL_COLOR_ATTACHMENT0, maps->textures[i], 0);
+  }
+
+  glCreateVertexArrays(1, &maps->fullscreenVao);
+  maps->surface = createSphereSurfaceTexture(std::min(size, maxDentSurfaceSize), sphereRadius);
+
+  maps->front = 0;
+  maps->size = size;
+  maps->staleRegions.clear();
+}
+
+void loadNormalMaps(NormalMaps* maps, std::string filename, float sphereRadius){
+  PNGImage image = loadPNGFile(filename);
+  if(image.width != image.height){
+    printf("Normal map %s must be square, but is %dx%d\n", filename.c_str(), image.width, image.height);
+    exit(-1);
+  }
+
+  createNormalMaps(maps, image.width, sphereRadius);
+  for(int i = 0; i < 2; i++){
+    glTextureSubImage2D(maps->textures[i], 0, 0, 0, image.width, image.height,
+			GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, image.pixels.data());
+  }
+}
+
+unsigned int frontNormalMap(const NormalMaps& maps){
+  return maps.textures[maps.front];
+}
+
+void syncBackNormalMap(NormalMaps* maps){
+  unsigned int front = maps->textures[maps->front];
+  unsigned int back = maps->textures[1 - maps->front];
+  int size = maps->size;
+
+  for(unsigned int i = 0; i < maps->staleRegions.size(); i++){
+    const DentRegion& region = maps->staleRegions[i];
+
+    // Regions crossing the seam are copied in two parts
+    int x = (region.x % size + size) % size;
+    int first = std::min(region.width, size - x);
+    glCopyImageSubData(front, GL_TEXTURE_2D, 0, x, region.y, 0,
+		       back, GL_TEXTURE_2D, 0, x, region.y, 0, first, region.height, 1);
+    if(first < region.width){
+      glCopyImageSubData(front, GL_TEXTURE_2D, 0, 0, region.y, 0,
+			 back, GL_TEXTURE_2D, 0, 0, region.y, 0, region.width - first, region.height, 1);
+    }
+  }
+
+  maps->staleRegions.clear();
+}
+
+void swapNormalMaps(NormalMaps* maps, const DentRegion* changed, int count){
+  maps->front = 1 - maps->front;
+  maps->staleRegions.insert(maps->staleRegions.end(), changed, changed + count);
+}
+
+void createImpactQueue(ImpactQueue* queue, int budget){
+  queue->pending.clear();
+  queue->budget = budget;
+  queue->maxPending = 16 * budget;
+  createStreamBuffer(&queue->buffer, budget * sizeof(glm::vec4));
+  queue->painted = 0;
+  queue->dropped = 0;
+}
+
+void queueImpact(ImpactQueue* queue, const glm::vec3& collision){
+  if((int)queue->pending.size() >= queue->maxPending){
+    queue->pending.pop_front();
+    queue->dropped++;
+  }
+  queue->pending.push_back(collision);
+}
+
+void takeImpacts(ImpactQueue* queue, std::vector<glm::vec3>* impacts){
+  int count = std::min((int)queue->pending.size(), queue->budget);
+  impacts->assign(queue->pending.begin(), queue->pending.begin() + count);
+  queue->pending.erase(queue->pending.begin(), queue->pending.begin() + count);
+  queue->painted += count;
+}
+
+void printImpactQueue(const ImpactQueue& queue){
+  printf("Impacts: %d painted, %d waiting, %d dropped (budget %d per frame)\n",
+	 queue.painted, (int)queue.pending.size(), queue.dropped, queue.budget);
+}
+
+// Hits whose dents overlap, and the region covering them
+struct DentCluster{
+  DentRegion region;
+  std::vector<int> hits;
+};
+
+// Groups the hits so that no two clusters share a texel
+static void clusterDents(const glm::vec3* collisions, int count, float sphereRadius, int size,
+			 std::vector<DentCluster>* clusters){
+  clusters->clear();
+  for(int i = 0; i < count; i++){
+    DentCluster cluster;
+    cluster.region = dentRegion(collisions[i], sphereRadius, size);
+    cluster.hits.push_back(i);
+
+    // A merged region is larger, so it may now overlap clusters it did not
+    for(unsigned int j = 0; j < clusters->size(); ){
+      DentRegion other = (*clusters)[j].region;
+      if(!dentRegionsOverlap(cluster.region, &other, size)){
+	j++;
+	continue;
+      }
+
+      cluster.region = mergeDentRegions(cluster.region, other, size);
+      cluster.hits.insert(cluster.hits.end(), (*clusters)[j].hits.begin(), (*clusters)[j].hits.end());
+      (*clusters)[j] = clusters->back();
+      clusters->pop_back();
+      j = 0;
+    }
+
+    // Hits on the same texels must be applied in the order they came in
+    std::sort(cluster.hits.begin(), cluster.hits.end());
+    clusters->push_back(cluster);
+  }
+}
+
+void paintDents(Gloom::Shader& shader, NormalMaps* maps, float sphereRadius,
+		StreamBuffer* impactBuffer, const glm::vec3* collisions, int count){
+  if(count == 0){
+    return;
+  }
+
+  std::vector<DentCluster> clusters;
+  clusterDents(collisions, count, sphereRadius, maps->size, &clusters);
+
+  // The hits of each cluster are consecutive in the buffer
+  std::vector<glm::vec4> impacts;
+  std::vector<DentRegion> regions;
+  for(unsigned int i = 0; i < clusters.size(); i++){
+    for(unsigned int j = 0; j < clusters[i].hits.size(); j++){
+      impacts.push_back(glm::vec4(collisions[clusters[i].hits[j]], 0.0f)); // std430 pads vec3 arrays to vec4
+    }
+    regions.push_back(clusters[i].region);
+  }
+
+  uploadStreamBuffer(impactBuffer, impacts.data(), count * sizeof(glm::vec4));
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, impactStorageBinding, impactBuffer->buffer);
+
+  // Only changed texels are stored, so the back copy has to match the front first
+  syncBackNormalMap(maps);
+  glUseProgram(shader.get());
+  glBindTextureUnit(0, maps->textures[maps->front]);
+  glBindTextureUnit(1, maps->surface);
+  glBindImageTexture(0, maps->textures[1 - maps->front], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+  // The clusters share no texels, so their dispatches need no barriers between them
+  const Gloom::Shader::Uniform dentFirst = shader.handle("dentFirst");
+  const Gloom::Shader::Uniform dentCount = shader.handle("dentCount");
+  const Gloom::Shader::Uniform regionOrigin = shader.handle("regionOrigin");
+  const Gloom::Shader::Uniform regionSize = shader.handle("regionSize");
+  int first = 0;
+  for(unsigned int i = 0; i < clusters.size(); i++){
+    const DentRegion& region = clusters[i].region;
+    shader.setUniform(dentFirst, first);
+    shader.setUniform(dentCount, (int)clusters[i].hits.size());
+    shader.setUniform(regionOrigin, glm::ivec2(region.x, region.y));
+    shader.setUniform(regionSize, glm::ivec2(region.width, region.height));
+    glDispatchCompute((region.width + 7) / 8, (region.height + 7) / 8, 1);
+    first += clusters[i].hits.size();
+  }
+  swapNormalMaps(maps, regions.data(), regions.size());
+
+  // The stores are read back by sampling, and by the copy into the next back copy
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
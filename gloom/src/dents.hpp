@@ -0,0 +1,110 @@
+#ifndef DENTS_HPP
+#define DENTS_HPP
+#pragma once
+
+#include "gloom/shader.hpp"
+#include "resources.hpp"
+
+#include "glm/glm.hpp"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+
+// Distance from a hit within which the normals are changed. Must match
+// maxdist in the dent shaders
+const float dentRadius = 0.3f;
+
+// Texel of an undented normal map, the encoded (0, 0, 1) normal
+const unsigned char flatNormalTexel[4] = {128, 128, 255, 255};
+
+// Shader storage binding of the hits read by dent.comp
+const int impactStorageBinding = 3;
+
+// Rectangle of texels in the sphere's normal map. x may lie outside
+// [0, size), it wraps around the u = 0 seam
+struct DentRegion{
+  int x, y;
+  int width, height;
+};
+
+// Largest surface texture baked for the dense normal map, about 12 MB.
+// Larger maps filter it, like the tiled map does, as baking one texel of
+// RGBA32F per layer and map texel would take twelve times the map itself
+const int maxDentSurfaceSize = 512;
+
+// Two copies of the sphere's normal map, so a dent never reads the texture
+// it writes. Dents read the front copy and write the back one, which then
+// becomes the front. The new back copy is then behind only in the regions
+// that changed, which are copied over before it is written again
+struct NormalMaps{
+  unsigned int textures[2];
+  unsigned int framebuffers[2]; // For the rasterized path
+  unsigned int fullscreenVao;   // Also for the rasterized path, which needs no vertex data
+  unsigned int surface;         // Position and tangent frame, see sphere_surface.hpp
+  int front;
+  int size;
+  std::vector<DentRegion> staleRegions;
+};
+
+// Hits waiting to be painted. At most budget of them are painted per frame
+// and the rest wait for later frames, so a burst of hits is spread out
+// instead of stalling one frame. Beyond maxPending the oldest are dropped
+struct ImpactQueue{
+  std::deque<glm::vec3> pending; // Oldest first
+  int budget;
+  int maxPending;
+
+  StreamBuffer buffer; // Hits of the current dent pass
+
+  int painted;
+  int dropped;
+};
+
+
+// Texels of a size x size normal map within dentRadius of a hit on a sphere
+// around the origin, following the uv layout of createSphereObject
+DentRegion dentRegion(const glm::vec3& collision, float sphereRadius, int size);
+
+// Smallest region covering both, never wider than the texture. b must be on
+// the same side of the seam as a, see dentRegionsOverlap
+DentRegion mergeDentRegions(const DentRegion& a, const DentRegion& b, int size);
+
+// Whether the regions share a texel. If they do, b is moved a whole turn
+// around the seam if needed, so that it lies next to a
+bool dentRegionsOverlap(const DentRegion& a, DentRegion* b, int size);
+
+// Creates both copies at size x size and clears them to the flat normal
+void createNormalMaps(NormalMaps* maps, int size, float sphereRadius);
+
+// Creates both copies from a pre-authored dent state, which must be square
+void loadNormalMaps(NormalMaps* maps, std::string filename, float sphereRadius);
+
+unsigned int frontNormalMap(const NormalMaps& maps);
+
+// Copies the stale regions from the front to the back copy
+void syncBackNormalMap(NormalMaps* maps);
+
+// Makes the back copy the front, after changing the given regions of it
+void swapNormalMaps(NormalMaps* maps, const DentRegion* changed, int count);
+
+void createImpactQueue(ImpactQueue* queue, int budget);
+
+void queueImpact(ImpactQueue* queue, const glm::vec3& collision);
+
+// Moves the oldest hits, at most the budget, from the queue into impacts
+void takeImpacts(ImpactQueue* queue, std::vector<glm::vec3>* impacts);
+
+void printImpactQueue(const ImpactQueue& queue);
+
+// Dents the normal maps around every hit with dent.comp, covering only the
+// texels around the hits. Hits whose regions overlap are dispatched together
+// over the region covering them all, and applied in order; the other hits
+// get dispatches of their own. The hits are uploaded to impactBuffer.
+// sphereRadius must be the one the surface was baked with
+void paintDents(Gloom::Shader& shader, NormalMaps* maps, float sphereRadius,
+		StreamBuffer* impactBuffer, const glm::vec3* collisions, int count);
+
+
+#endif
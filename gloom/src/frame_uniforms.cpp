@@ -0,0 +1,35 @@
+#include "frame_uniforms.hpp"
+#include "resources.hpp"
+
+#include <cstring>
+
+
+void createFrameUniformBuffer(FrameUniformBuffer* frame){
+  int alignment;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  frame->stride = (sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+  frame->staging.assign(frame->stride * frameUniformSlots, 0);
+
+  frame->buffer = createBuffer(frame->staging.size(), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+  bindFrameUniforms(*frame, mainViewSlot);
+}
+
+void setFrameUniforms(FrameUniformBuffer* frame, int slot, const FrameUniforms& uniforms){
+  memcpy(&frame->staging[slot * frame->stride], &uniforms, sizeof(FrameUniforms));
+}
+
+void uploadFrameUniforms(FrameUniformBuffer* frame){
+  glNamedBufferSubData(frame->buffer, 0, frame->staging.size(), frame->staging.data());
+}
+
+void bindFrameUniforms(const FrameUniformBuffer& frame, int slot){
+  glBindBufferRange(GL_UNIFORM_BUFFER, frameUniformBinding, frame.buffer,
+		    slot * frame.stride, sizeof(FrameUniforms));
+}
+
+unsigned int createProbeViewsBuffer(const glm::mat4 faceViews[6]){
+  unsigned int buffer = createBuffer(6 * sizeof(glm::mat4), faceViews);
+  glBindBufferBase(GL_UNIFORM_BUFFER, probeViewsUniformBinding, buffer);
+  return buffer;
+}
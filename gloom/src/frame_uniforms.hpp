@@ -0,0 +1,51 @@
+#ifndef FRAME_UNIFORMS_HPP
+#define FRAME_UNIFORMS_HPP
+#pragma once
+
+#include <glad/glad.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+
+// Uniform block binding points shared with the shaders
+const int frameUniformBinding = 0;
+const int probeViewsUniformBinding = 1;
+
+// Slots in the frame uniform buffer: the camera, then one per cube map face
+const int mainViewSlot = 0;
+const int probeFaceSlot = 1;
+const int frameUniformSlots = 7;
+
+// Mirrors the std140 Frame uniform block in the shaders
+struct FrameUniforms{
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec4 lightPosition; // w is padding
+};
+
+// One buffer holding a FrameUniforms per view, each slot aligned so it can
+// be bound on its own with glBindBufferRange
+struct FrameUniformBuffer{
+  unsigned int buffer;
+  int stride;
+  std::vector<unsigned char> staging;
+};
+
+
+void createFrameUniformBuffer(FrameUniformBuffer* frame);
+
+// Writes a slot to the CPU-side copy; nothing is sent until uploadFrameUniforms
+void setFrameUniforms(FrameUniformBuffer* frame, int slot, const FrameUniforms& uniforms);
+
+// Sends every slot to the GPU in one call
+void uploadFrameUniforms(FrameUniformBuffer* frame);
+
+// Makes the Frame block of all programs read from the given slot
+void bindFrameUniforms(const FrameUniformBuffer& frame, int slot);
+
+// Creates the buffer behind the ProbeViews block and binds it
+unsigned int createProbeViewsBuffer(const glm::mat4 faceViews[6]);
+
+
+#endif
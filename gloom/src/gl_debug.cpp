@@ -0,0 +1,163 @@
+#include "gl_debug.hpp"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+#if GLOOM_GL_CHECKS
+
+struct GLDebugState{
+  std::mutex mutex; // Drivers may call back from a thread of their own
+  std::map<std::string, int> repeats; // Since the last summary, by message
+  int suppressed;  // Not printed because of the rate limit, since the last summary
+  int printed;     // In the current second
+  std::chrono::steady_clock::time_point second;
+};
+
+static GLDebugState debugState;
+
+static const char* debugSeverityName(GLenum severity){
+  switch(severity){
+  case GL_DEBUG_SEVERITY_HIGH:
+    return "high";
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return "medium";
+  case GL_DEBUG_SEVERITY_LOW:
+    return "low";
+  default:
+    return "notification";
+  }
+}
+
+static const char* debugTypeName(GLenum type){
+  switch(type){
+  case GL_DEBUG_TYPE_ERROR:
+    return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+    return "deprecated behaviour";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+    return "undefined behaviour";
+  case GL_DEBUG_TYPE_PORTABILITY:
+    return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE:
+    return "performance";
+  default:
+    return "message";
+  }
+}
+
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+				  GLsizei length, const GLchar* message, const void* user){
+  (void)source;
+  (void)user;
+  std::string text(message, length >= 0 ? length : strlen(message));
+
+  std::lock_guard<std::mutex> lock(debugState.mutex);
+  std::map<std::string, int>::iterator seen = debugState.repeats.find(text);
+  if(seen != debugState.repeats.end()){
+    seen->second++;
+    return;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if(now - debugState.second >= std::chrono::seconds(1)){
+    debugState.second = now;
+    debugState.printed = 0;
+  }
+  if(debugState.printed >= glDebugMessagesPerSecond || (int)debugState.repeats.size() >= glDebugMaxDistinct){
+    debugState.suppressed++;
+    return;
+  }
+
+  debugState.printed++;
+  debugState.repeats[text] = 0;
+  fprintf(stderr, "OpenGL %s (%s, id %u): %s\n", debugTypeName(type), debugSeverityName(severity), id, text.c_str());
+}
+
+#endif
+
+
+void enableGLDebugOutput(){
+#if GLOOM_GL_CHECKS
+  debugState.suppressed = 0;
+  debugState.printed = 0;
+  debugState.second = std::chrono::steady_clock::now();
+
+  glEnable(GL_DEBUG_OUTPUT);
+  glDebugMessageCallback(debugMessage, NULL);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+  glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, NULL, GL_FALSE);
+  glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, NULL, GL_FALSE);
+#endif
+}
+
+void printGLDebugSummary(){
+#if GLOOM_GL_CHECKS
+  std::lock_guard<std::mutex> lock(debugState.mutex);
+  for(std::map<std::string, int>::iterator i = debugState.repeats.begin(); i != debugState.repeats.end(); i++){
+    if(i->second > 0){
+      fprintf(stderr, "OpenGL message repeated %d times: %s\n", i->second, i->first.c_str());
+    }
+  }
+  if(debugState.suppressed > 0){
+    fprintf(stderr, "OpenGL: %d more messages not printed\n", debugState.suppressed);
+  }
+
+  // Messages that keep coming are printed again after each summary
+  debugState.repeats.clear();
+  debugState.suppressed = 0;
+#endif
+}
+
+void reportGLError(const char* message){
+#if GLOOM_GL_CHECKS
+  debugMessage(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_ERROR, 0, GL_DEBUG_SEVERITY_HIGH,
+	       -1, message, NULL);
+#else
+  fprintf(stderr, "OpenGL error: %s\n", message);
+#endif
+}
+
+void printGLError(){
+  int errorID = glGetError();
+
+  if(errorID != GL_NO_ERROR) {
+    std::string errorString;
+
+    switch(errorID) {
+    case GL_INVALID_ENUM:
+      errorString = "GL_INVALID_ENUM";
+      break;
+    case GL_INVALID_OPERATION:
+      errorString = "GL_INVALID_OPERATION";
+      break;
+    case GL_INVALID_FRAMEBUFFER_OPERATION:
+      errorString = "GL_INVALID_FRAMEBUFFER_OPERATION";
+      break;
+    case GL_OUT_OF_MEMORY:
+      errorString = "GL_OUT_OF_MEMORY";
+      break;
+    case GL_STACK_UNDERFLOW:
+      errorString = "GL_STACK_UNDERFLOW";
+      break;
+    case GL_STACK_OVERFLOW:
+      errorString = "GL_STACK_OVERFLOW";
+      break;
+    case GL_INVALID_VALUE:
+      errorString = "GL_INVALID_VALUE";
+      break;
+    default:
+      errorString = "[Unknown error ID]";
+      break;
+    }
+
+    fprintf(stderr, "An OpenGL error occurred (%i): %s.\n",
+	    errorID, errorString.c_str());
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef GL_DEBUG_HPP
+#define GL_DEBUG_HPP
+#pragma once
+
+// OpenGL error reporting through the KHR_debug message callback, in place of
+// polling glGetError, which makes many drivers wait for the GPU. The checks
+// are compiled in unless NDEBUG is defined, as it is in Release builds, and
+// GLOOM_GL_CHECKS=0 or 1 overrides that
+
+
+#ifndef GLOOM_GL_CHECKS
+#ifdef NDEBUG
+#define GLOOM_GL_CHECKS 0
+#else
+#define GLOOM_GL_CHECKS 1
+#endif
+#endif
+
+// Distinct messages printed per second at most, the rest are only counted
+const int glDebugMessagesPerSecond = 10;
+
+// Distinct messages remembered, later new ones are only counted
+const int glDebugMaxDistinct = 256;
+
+
+// Installs the callback for the current context. Repeats of a message are
+// counted rather than printed, and notifications and debug group messages
+// are ignored. Does nothing when the checks are compiled out
+void enableGLDebugOutput();
+
+// Prints how often the messages seen since the last summary were repeated
+// or suppressed, if at all
+void printGLDebugSummary();
+
+// Reports an error the program found itself, such as a failed fence wait,
+// with the same deduplication and rate limit as the driver's messages. It
+// is printed as is when the checks are compiled out
+void reportGLError(const char* message);
+
+// Checks for whether an OpenGL error occurred. If one did, it prints out the
+// error type and ID. Waits for the GPU, so only for chasing down a bug
+void printGLError();
+
+
+#endif
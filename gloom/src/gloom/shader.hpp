@@ -4,12 +4,16 @@
 
 // System headers
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 // Standard headers
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 
 namespace Gloom
@@ -17,7 +21,7 @@ namespace Gloom
     class Shader
     {
     public:
-        Shader()            { mProgram = glCreateProgram(); }
+        Shader()            { mProgram = glCreateProgram(); mSkipRedundant = true; }
 
         // Public member functions
         void   activate()   { glUseProgram(mProgram); }
@@ -82,6 +86,8 @@ namespace Gloom
             }
 
             assert(mStatus);
+
+            reflect();
         }
 
 
@@ -131,7 +137,143 @@ namespace Gloom
             else                    return false;
         }
 
+        /* Handle of a uniform, for the setters on the per-draw path. Looked
+           up once after linking, it stays valid until the next link */
+        struct Uniform { int index; };
+
+        Uniform handle(char const *name) { return Uniform{ find(name) }; }
+
+        /* Location of a uniform, -1 if it is not active */
+        GLint uniform(char const *name)
+        {
+            int index = find(name);
+            return index < 0 ? -1 : mUniforms[index].location;
+        }
+
+
+        /* Typed uniform setters. Uniforms that are not active are ignored,
+           and values equal to the last upload are skipped unless disabled */
+        void setUniform(Uniform uniform, GLint value)
+        {
+            if (auto info = upload(uniform, &value, sizeof(value)))
+                glProgramUniform1i(mProgram, info->location, value);
+        }
+
+        void setUniform(Uniform uniform, GLfloat value)
+        {
+            if (auto info = upload(uniform, &value, sizeof(value)))
+                glProgramUniform1f(mProgram, info->location, value);
+        }
+
+        void setUniform(Uniform uniform, glm::vec3 const &value)
+        {
+            if (auto info = upload(uniform, glm::value_ptr(value), sizeof(value)))
+                glProgramUniform3fv(mProgram, info->location, 1, glm::value_ptr(value));
+        }
+
+        void setUniform(Uniform uniform, glm::ivec2 const &value)
+        {
+            if (auto info = upload(uniform, glm::value_ptr(value), sizeof(value)))
+                glProgramUniform2iv(mProgram, info->location, 1, glm::value_ptr(value));
+        }
+
+        void setUniform(Uniform uniform, glm::mat4 const &value)
+        {
+            setUniform(uniform, &value, 1);
+        }
+
+        void setUniform(Uniform uniform, glm::mat4 const *values, GLsizei count)
+        {
+            if (auto info = upload(uniform, values, count * sizeof(glm::mat4)))
+                glProgramUniformMatrix4fv(mProgram, info->location, count, GL_FALSE,
+                                          glm::value_ptr(values[0]));
+        }
+
+        /* By name, for uniforms set once or once a frame */
+        template <typename T>
+        void setUniform(char const *name, T const &value)
+        {
+            setUniform(handle(name), value);
+        }
+
+        void setUniform(char const *name, glm::mat4 const *values, GLsizei count)
+        {
+            setUniform(handle(name), values, count);
+        }
+
+        void setRedundantUploadSkipping(bool skip) { mSkipRedundant = skip; }
+
     private:
+        struct UniformInfo
+        {
+            std::string name;
+            GLint location;
+            std::vector<unsigned char> lastValue; // Empty until first upload
+        };
+
+
+        /* Builds the uniform table of the linked program. Vertex attributes
+           have fixed locations in the shaders, so they are not looked up */
+        void reflect()
+        {
+            mUniforms.clear();
+
+            const GLenum properties[] = { GL_LOCATION };
+            char name[256];
+
+            GLint count;
+            glGetProgramInterfaceiv(mProgram, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                GLint location;
+                glGetProgramResourceiv(mProgram, GL_UNIFORM, i, 1, properties, 1, nullptr, &location);
+                if (location < 0) continue; // Uniform block member
+
+                glGetProgramResourceName(mProgram, GL_UNIFORM, i, sizeof(name), nullptr, name);
+                UniformInfo info;
+                info.name = arrayBaseName(name);
+                info.location = location;
+                mUniforms.push_back(info);
+            }
+        }
+
+
+        /* Arrays are reported as "name[0]", but looked up as "name" */
+        static std::string arrayBaseName(std::string const &name)
+        {
+            auto idx = name.rfind("[0]");
+            if (idx != std::string::npos && idx + 3 == name.size())
+                return name.substr(0, idx);
+            return name;
+        }
+
+
+        /* Index of a uniform in the table, -1 if it is not active. A
+           program has few uniforms, so a scan beats hashing a new string */
+        int find(char const *name) const
+        {
+            for (size_t i = 0; i < mUniforms.size(); i++)
+                if (mUniforms[i].name == name)
+                    return int(i);
+            return -1;
+        }
+
+
+        /* Returns the uniform to upload to, or nullptr if the upload can be skipped */
+        UniformInfo * upload(Uniform uniform, void const *data, size_t size)
+        {
+            if (uniform.index < 0) return nullptr;
+
+            UniformInfo &info = mUniforms[uniform.index];
+            if (mSkipRedundant && info.lastValue.size() == size
+                && !memcmp(info.lastValue.data(), data, size))
+                return nullptr;
+
+            auto bytes = static_cast<unsigned char const *>(data);
+            info.lastValue.assign(bytes, bytes + size);
+            return &info;
+        }
+
         // Disable copying and assignment
         Shader(Shader const &) = delete;
         Shader & operator =(Shader const &) = delete;
@@ -140,6 +282,9 @@ namespace Gloom
         GLuint mProgram;
         GLint  mStatus;
         GLint  mLength;
+        bool   mSkipRedundant;
+
+        std::vector<UniformInfo> mUniforms;
     };
 }
 
@@ -0,0 +1,239 @@
+#include "headless.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdio>
+
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+
+#ifdef __linux__
+
+// The little of EGL and OSMesa used here, so their headers are not needed
+
+typedef int EGLint;
+typedef unsigned int EGLBoolean;
+typedef unsigned int EGLenum;
+typedef void* EGLDisplay;
+typedef void* EGLConfig;
+typedef void* EGLContext;
+typedef void* EGLSurface;
+typedef void* EGLDeviceEXT;
+
+#define EGL_NONE 0x3038
+#define EGL_SURFACE_TYPE 0x3033
+#define EGL_PBUFFER_BIT 0x0001
+#define EGL_RENDERABLE_TYPE 0x3040
+#define EGL_OPENGL_BIT 0x0008
+#define EGL_OPENGL_API 0x30A2
+#define EGL_CONTEXT_MAJOR_VERSION 0x3098
+#define EGL_CONTEXT_MINOR_VERSION 0x30FB
+#define EGL_CONTEXT_OPENGL_PROFILE_MASK 0x30FD
+#define EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT 0x0001
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#define EGL_PLATFORM_DEVICE_EXT 0x313F
+
+typedef void* (*PFN_eglGetProcAddress)(const char*);
+typedef EGLDisplay (*PFN_eglGetPlatformDisplayEXT)(EGLenum, void*, const EGLint*);
+typedef EGLBoolean (*PFN_eglQueryDevicesEXT)(EGLint, EGLDeviceEXT*, EGLint*);
+typedef EGLBoolean (*PFN_eglInitialize)(EGLDisplay, EGLint*, EGLint*);
+typedef EGLBoolean (*PFN_eglTerminate)(EGLDisplay);
+typedef EGLBoolean (*PFN_eglBindAPI)(EGLenum);
+typedef EGLBoolean (*PFN_eglChooseConfig)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*);
+typedef EGLContext (*PFN_eglCreateContext)(EGLDisplay, EGLConfig, EGLContext, const EGLint*);
+typedef EGLBoolean (*PFN_eglDestroyContext)(EGLDisplay, EGLContext);
+typedef EGLBoolean (*PFN_eglMakeCurrent)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+
+typedef void* OSMesaContext;
+
+#define OSMESA_FORMAT 0x22
+#define OSMESA_DEPTH_BITS 0x30
+#define OSMESA_PROFILE 0x33
+#define OSMESA_CORE_PROFILE 0x34
+#define OSMESA_CONTEXT_MAJOR_VERSION 0x36
+#define OSMESA_CONTEXT_MINOR_VERSION 0x37
+
+typedef OSMesaContext (*PFN_OSMesaCreateContextAttribs)(const int*, OSMesaContext);
+typedef void (*PFN_OSMesaDestroyContext)(OSMesaContext);
+typedef unsigned char (*PFN_OSMesaMakeCurrent)(OSMesaContext, void*, int, int, int);
+typedef void* (*PFN_OSMesaGetProcAddress)(const char*);
+
+// glad loads through these, set once the library is open
+static PFN_eglGetProcAddress eglGetProcAddress;
+static PFN_OSMesaGetProcAddress OSMesaGetProcAddress;
+
+static void* loadEglFunction(const char* name){
+  return eglGetProcAddress(name);
+}
+
+static void* loadOSMesaFunction(const char* name){
+  return OSMesaGetProcAddress(name);
+}
+
+// First of the names that opens
+static void* openLibrary(const char* const* names, int count){
+  for(int i = 0; i < count; i++){
+    void* library = dlopen(names[i], RTLD_LAZY | RTLD_LOCAL);
+    if(library != NULL){
+      return library;
+    }
+  }
+  return NULL;
+}
+
+static bool createEglContext(HeadlessContext* context){
+  const char* names[] = {"libEGL.so.1", "libEGL.so"};
+  context->library = openLibrary(names, 2);
+  if(context->library == NULL){
+    return false;
+  }
+
+  eglGetProcAddress = (PFN_eglGetProcAddress)dlsym(context->library, "eglGetProcAddress");
+  PFN_eglInitialize eglInitialize = (PFN_eglInitialize)dlsym(context->library, "eglInitialize");
+  PFN_eglBindAPI eglBindAPI = (PFN_eglBindAPI)dlsym(context->library, "eglBindAPI");
+  PFN_eglChooseConfig eglChooseConfig = (PFN_eglChooseConfig)dlsym(context->library, "eglChooseConfig");
+  PFN_eglCreateContext eglCreateContext = (PFN_eglCreateContext)dlsym(context->library, "eglCreateContext");
+  PFN_eglMakeCurrent eglMakeCurrent = (PFN_eglMakeCurrent)dlsym(context->library, "eglMakeCurrent");
+  if(!eglGetProcAddress || !eglInitialize || !eglBindAPI || !eglChooseConfig
+     || !eglCreateContext || !eglMakeCurrent){
+    dlclose(context->library);
+    return false;
+  }
+
+  PFN_eglGetPlatformDisplayEXT eglGetPlatformDisplayEXT =
+    (PFN_eglGetPlatformDisplayEXT)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  PFN_eglQueryDevicesEXT eglQueryDevicesEXT =
+    (PFN_eglQueryDevicesEXT)eglGetProcAddress("eglQueryDevicesEXT");
+
+  // Mesa renders without any surface at all, other drivers want a device
+  context->display = NULL;
+  if(eglGetPlatformDisplayEXT){
+    context->display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, NULL, NULL);
+    EGLDeviceEXT device;
+    EGLint devices;
+    if(context->display == NULL && eglQueryDevicesEXT && eglQueryDevicesEXT(1, &device, &devices) && devices > 0){
+      context->display = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+    }
+  }
+  if(context->display == NULL || !eglInitialize(context->display, NULL, NULL)){
+    dlclose(context->library);
+    return false;
+  }
+
+  const EGLint configAttributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 5,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+  };
+
+  EGLConfig config;
+  EGLint configs = 0;
+  context->context = NULL;
+  if(eglBindAPI(EGL_OPENGL_API)
+     && eglChooseConfig(context->display, configAttributes, &config, 1, &configs) && configs > 0){
+    context->context = eglCreateContext(context->display, config, NULL, contextAttributes);
+  }
+  if(context->context == NULL || !eglMakeCurrent(context->display, NULL, NULL, context->context)){
+    ((PFN_eglTerminate)dlsym(context->library, "eglTerminate"))(context->display);
+    dlclose(context->library);
+    return false;
+  }
+
+  gladLoadGLLoader(loadEglFunction);
+  return true;
+}
+
+static bool createOSMesaContext(HeadlessContext* context){
+  const char* names[] = {"libOSMesa.so.8", "libOSMesa.so.6", "libOSMesa.so"};
+  context->library = openLibrary(names, 3);
+  if(context->library == NULL){
+    return false;
+  }
+
+  PFN_OSMesaCreateContextAttribs OSMesaCreateContextAttribs =
+    (PFN_OSMesaCreateContextAttribs)dlsym(context->library, "OSMesaCreateContextAttribs");
+  PFN_OSMesaMakeCurrent OSMesaMakeCurrent =
+    (PFN_OSMesaMakeCurrent)dlsym(context->library, "OSMesaMakeCurrent");
+  OSMesaGetProcAddress = (PFN_OSMesaGetProcAddress)dlsym(context->library, "OSMesaGetProcAddress");
+  if(!OSMesaCreateContextAttribs || !OSMesaMakeCurrent || !OSMesaGetProcAddress){
+    dlclose(context->library);
+    return false;
+  }
+
+  const int attributes[] = {
+    OSMESA_FORMAT, GL_RGBA,
+    OSMESA_DEPTH_BITS, 24,
+    OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+    OSMESA_CONTEXT_MAJOR_VERSION, 4,
+    OSMESA_CONTEXT_MINOR_VERSION, 5,
+    0
+  };
+
+  // Everything is drawn into framebuffer objects, so the buffer that makes
+  // the context current is never drawn into and can be a single pixel
+  context->display = NULL;
+  context->buffer.resize(4);
+  context->context = OSMesaCreateContextAttribs(attributes, NULL);
+  if(context->context == NULL
+     || !OSMesaMakeCurrent(context->context, context->buffer.data(), GL_UNSIGNED_BYTE, 1, 1)){
+    dlclose(context->library);
+    return false;
+  }
+
+  gladLoadGLLoader(loadOSMesaFunction);
+  return true;
+}
+
+#endif
+
+
+bool createHeadlessContext(HeadlessContext* context, HeadlessBackend backend){
+#ifdef __linux__
+  if((backend == HEADLESS_AUTO || backend == HEADLESS_EGL) && createEglContext(context)){
+    context->backend = HEADLESS_EGL;
+    return true;
+  }
+  if((backend == HEADLESS_AUTO || backend == HEADLESS_OSMESA) && createOSMesaContext(context)){
+    context->backend = HEADLESS_OSMESA;
+    return true;
+  }
+#else
+  (void)context;
+  (void)backend;
+#endif
+  return false;
+}
+
+void destroyHeadlessContext(HeadlessContext* context){
+#ifdef __linux__
+  if(context->backend == HEADLESS_EGL){
+    ((PFN_eglMakeCurrent)dlsym(context->library, "eglMakeCurrent"))(context->display, NULL, NULL, NULL);
+    ((PFN_eglDestroyContext)dlsym(context->library, "eglDestroyContext"))(context->display, context->context);
+    ((PFN_eglTerminate)dlsym(context->library, "eglTerminate"))(context->display);
+  }else{
+    ((PFN_OSMesaDestroyContext)dlsym(context->library, "OSMesaDestroyContext"))(context->context);
+  }
+  dlclose(context->library);
+#else
+  (void)context;
+#endif
+}
+
+const char* headlessBackendName(HeadlessBackend backend){
+  switch(backend){
+  case HEADLESS_EGL:
+    return "EGL";
+  case HEADLESS_OSMESA:
+    return "OSMesa";
+  default:
+    return "auto";
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+#pragma once
+
+// OpenGL contexts without a window, for running where there is no display.
+// The libraries are loaded at runtime, so gloom neither links against them
+// nor needs them unless a headless context is asked for
+
+#include <vector>
+
+
+enum HeadlessBackend{
+  HEADLESS_AUTO,   // EGL, then OSMesa
+  HEADLESS_EGL,    // Surfaceless, or the first device when that is missing
+  HEADLESS_OSMESA, // Software rendering in Mesa, needs no GPU
+};
+
+struct HeadlessContext{
+  HeadlessBackend backend; // The one in use
+  void* library;
+  void* display;           // Only for EGL
+  void* context;
+  std::vector<unsigned char> buffer; // OSMesa needs one to be current
+};
+
+
+// Creates an OpenGL 4.5 core context, makes it current and loads the OpenGL
+// functions. There is no default framebuffer to draw into. False when the
+// backend is not available
+bool createHeadlessContext(HeadlessContext* context, HeadlessBackend backend);
+
+void destroyHeadlessContext(HeadlessContext* context);
+
+const char* headlessBackendName(HeadlessBackend backend);
+
+
+#endif
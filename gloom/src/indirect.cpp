@@ -0,0 +1,84 @@
+#include "indirect.hpp"
+
+#include <algorithm>
+
+
+void createIndirectDraws(IndirectDraws* draws){
+  createStreamBuffer(&draws->commandBuffer, 64 * sizeof(DrawElementsIndirectCommand));
+  createStreamBuffer(&draws->objectBuffer, 64 * sizeof(ObjectData));
+  draws->objectIndexBuffer = 0;
+  draws->objectIndexCapacity = 0;
+}
+
+void clearIndirectDraws(IndirectDraws* draws){
+  draws->commands.clear();
+  draws->objects.clear();
+}
+
+int addIndirectObjects(IndirectDraws* draws, const glm::mat4* models, int count){
+  int first = draws->objects.size();
+  for(int i = 0; i < count; i++){
+    ObjectData object;
+    object.model = models[i];
+    object.faceMask = 0x3f;
+    draws->objects.push_back(object);
+  }
+  return first;
+}
+
+DrawSegment beginDrawSegment(const IndirectDraws& draws){
+  DrawSegment segment;
+  segment.first = draws.commands.size();
+  segment.count = 0;
+  return segment;
+}
+
+void endDrawSegment(const IndirectDraws& draws, DrawSegment* segment){
+  segment->count = draws.commands.size() - segment->first;
+}
+
+void uploadIndirectDraws(IndirectDraws* draws, unsigned int vao){
+  // The object index attribute has no gl_DrawID to lean on (that needs GL 4.6),
+  // but instanced attributes start at baseInstance, so the identity sequence
+  // gives every instance of every command its own object index
+  int objectCount = draws->objects.size();
+  if(objectCount > draws->objectIndexCapacity){
+    int capacity = std::max(64, 2 * objectCount);
+    std::vector<GLuint> indices(capacity);
+    for(int i = 0; i < capacity; i++){
+      indices[i] = i;
+    }
+
+    // The contents never change, only grow, so a new immutable buffer
+    // replaces the old one
+    glDeleteBuffers(1, &draws->objectIndexBuffer);
+    draws->objectIndexBuffer = createBuffer(capacity * sizeof(GLuint), indices.data());
+
+    glVertexArrayVertexBuffer(vao, objectIndexBinding, draws->objectIndexBuffer, 0, sizeof(GLuint));
+    glVertexArrayAttribIFormat(vao, objectIndexAttribute, 1, GL_UNSIGNED_INT, 0);
+    glVertexArrayAttribBinding(vao, objectIndexAttribute, objectIndexBinding);
+    glVertexArrayBindingDivisor(vao, objectIndexBinding, 1);
+    glEnableVertexArrayAttrib(vao, objectIndexAttribute);
+
+    draws->objectIndexCapacity = capacity;
+  }
+
+  uploadStreamBuffer(&draws->commandBuffer, draws->commands.data(),
+		     draws->commands.size() * sizeof(DrawElementsIndirectCommand));
+  uploadStreamBuffer(&draws->objectBuffer, draws->objects.data(),
+		     draws->objects.size() * sizeof(ObjectData));
+
+  // Binding points rather than edit targets, the draws read from these
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draws->commandBuffer.buffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, objectDataStorageBinding, draws->objectBuffer.buffer);
+}
+
+void drawIndirectSegment(const DrawSegment& segment){
+  if(segment.count == 0){
+    return;
+  }
+
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			      (void*)(segment.first * sizeof(DrawElementsIndirectCommand)),
+			      segment.count, 0);
+}
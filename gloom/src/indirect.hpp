@@ -0,0 +1,77 @@
+#ifndef INDIRECT_HPP
+#define INDIRECT_HPP
+#pragma once
+
+#include <glad/glad.h>
+#include "glm/glm.hpp"
+
+#include "resources.hpp"
+
+#include <vector>
+
+
+// Shader storage binding of the per-object data read by the vertex shaders
+const int objectDataStorageBinding = 2;
+
+// Vertex attribute holding the index into the object data, and the vertex
+// buffer binding it reads from
+const int objectIndexAttribute = 9;
+const int objectIndexBinding = 9;
+
+// Layout defined by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand{
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// Mirrors the std430 ObjectData struct in the shaders
+struct ObjectData{
+  glm::mat4 model;
+  GLint faceMask; // Cube map faces that can see the object, for layered rendering
+  GLint padding[3];
+};
+
+// A range of commands drawn with a single glMultiDrawElementsIndirect
+struct DrawSegment{
+  int first;
+  int count;
+};
+
+// All per-frame data for indirect drawing. Commands and object data are
+// filled in on the CPU and uploaded together
+struct IndirectDraws{
+  StreamBuffer commandBuffer;
+  StreamBuffer objectBuffer;
+
+  unsigned int objectIndexBuffer; // 0, 1, 2, ... read with divisor 1
+  int objectIndexCapacity;
+
+  std::vector<DrawElementsIndirectCommand> commands;
+  std::vector<ObjectData> objects;
+};
+
+
+void createIndirectDraws(IndirectDraws* draws);
+
+void clearIndirectDraws(IndirectDraws* draws);
+
+// Appends object data entries and returns the index of the first one
+int addIndirectObjects(IndirectDraws* draws, const glm::mat4* models, int count);
+
+// Starts a new segment at the end of the command list
+DrawSegment beginDrawSegment(const IndirectDraws& draws);
+
+void endDrawSegment(const IndirectDraws& draws, DrawSegment* segment);
+
+// Uploads commands and object data, and makes sure the object index
+// attribute of vao covers every object
+void uploadIndirectDraws(IndirectDraws* draws, unsigned int vao);
+
+// Draws one segment with the current program and vao
+void drawIndirectSegment(const DrawSegment& segment);
+
+
+#endif
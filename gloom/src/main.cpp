@@ -1,6 +1,8 @@
 // Local headers
 #include "gloom/gloom.hpp"
 #include "program.hpp"
+#include "dent_tiles.hpp"
+#include "gl_debug.hpp"
 
 // System headers
 #include <glad/glad.h>
@@ -8,6 +10,7 @@
 
 // Standard headers
 #include <cstdlib>
+#include <cstring>
 
 
 // A callback which allows GLFW to report errors whenever they occur
@@ -30,6 +33,7 @@ GLFWwindow* initialise()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLOOM_GL_CHECKS);
 
     // Enable the GLFW runtime error callback function defined previously.
     glfwSetErrorCallback(glfwErrorCallback);
@@ -67,13 +71,171 @@ GLFWwindow* initialise()
 }
 
 
+// Creates an OpenGL context without a window, exits if there is none
+static void initialiseHeadless(HeadlessContext* context, HeadlessBackend backend)
+{
+    if (!createHeadlessContext(context, backend))
+    {
+        fprintf(stderr, "Could not create a headless OpenGL context with %s\n",
+                headlessBackendName(backend));
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
+    printf("Headless %s\n", headlessBackendName(context->backend));
+    printf("OpenGL\t %s\n", glGetString(GL_VERSION));
+    printf("GLSL\t %s\n\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+}
+
+
+static void printUsage(const char* name)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --probe-mode all|round-robin|motion  How cube map faces are scheduled for update\n"
+        "  --probe-faces N                      Faces updated per frame when time-sliced (1-6)\n"
+        "  --probe-max-age N                    Frames a changed face may wait in motion mode\n"
+        "  --probe-motion-threshold X           Movement below which a face counts as unchanged\n"
+        "  --probe-size N                       Resolution of each cube map face\n"
+        "  --probe-prefilter                    Sample blurred probe levels in dented regions\n"
+        "  --orbiters N                         Number of spheres orbiting the ball\n"
+        "  --packed-vertices                    Use the compact interleaved vertex format\n"
+        "  --fire-rate X                        Shots per second while SPACE is held\n"
+        "  --shot-spread X                      Random deviation of each shot, in radians\n"
+        "  --dent-budget N                      Most hits painted per frame, the rest wait\n"
+        "  --dent-map-size N                    Resolution of the ball's normal map\n"
+        "  --dent-map FILE                      Start from the dents in a square PNG normal map\n"
+        "  --tiled-dent-map N                   Dent a sparse N x N tiled normal map instead\n"
+        "  --dent-journal PATH                  Keep the dents across runs in PATH and PATH.snapshot\n"
+        "  --dent-snapshot-interval N           Journaled hits between snapshots of the normal map\n"
+        "  --telemetry DIR                      Export the normal map and probe to DIR as PNGs\n"
+        "  --telemetry-interval N               Frames between exports\n"
+        "  --headless N                         Render N frames without a window, then exit\n"
+        "  --headless-backend auto|egl|osmesa   How the headless OpenGL context is created\n"
+        "  --headless-output FILE               Write the last headless frame to a PNG\n"
+        "  --pass-timings FILE                  Append the pass timings here on T and at exit\n"
+        "  --trace FILE                         Write a Chrome trace of the run (needs GLOOM_PROFILER)\n"
+        "  --trace-events N                     Events kept per thread, the latest ones win\n",
+        name);
+}
+
+
+// Fills in settings from the command line, exits on unknown options
+ProgramSettings parseSettings(int argc, char* argb[])
+{
+    ProgramSettings settings = defaultProgramSettings();
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+
+        if (!strcmp(argb[i], "--probe-mode") && hasValue)
+        {
+            const char* mode = argb[++i];
+                 if (!strcmp(mode, "all"))         settings.probeScheduler.mode = PROBE_UPDATE_ALL;
+            else if (!strcmp(mode, "round-robin")) settings.probeScheduler.mode = PROBE_UPDATE_ROUND_ROBIN;
+            else if (!strcmp(mode, "motion"))      settings.probeScheduler.mode = PROBE_UPDATE_MOTION_PRIORITY;
+            else
+            {
+                printUsage(argb[0]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argb[i], "--probe-faces") && hasValue)
+            settings.probeScheduler.facesPerFrame = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--probe-max-age") && hasValue)
+            settings.probeScheduler.maxFaceAge = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--probe-motion-threshold") && hasValue)
+            settings.probeScheduler.motionThreshold = atof(argb[++i]);
+        else if (!strcmp(argb[i], "--probe-size") && hasValue)
+            settings.probeSize = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--probe-prefilter"))
+            settings.probePrefilter = true;
+        else if (!strcmp(argb[i], "--orbiters") && hasValue)
+            settings.orbiterCount = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--packed-vertices"))
+            settings.packedVertices = true;
+        else if (!strcmp(argb[i], "--fire-rate") && hasValue)
+            settings.fireRate = atof(argb[++i]);
+        else if (!strcmp(argb[i], "--shot-spread") && hasValue)
+            settings.shotSpread = atof(argb[++i]);
+        else if (!strcmp(argb[i], "--dent-budget") && hasValue)
+            settings.dentBudget = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--dent-map-size") && hasValue)
+            settings.dentMapSize = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--dent-map") && hasValue)
+            settings.dentMapFile = argb[++i];
+        else if (!strcmp(argb[i], "--tiled-dent-map") && hasValue)
+            settings.tiledDentMap = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--dent-journal") && hasValue)
+            settings.dentJournal = argb[++i];
+        else if (!strcmp(argb[i], "--dent-snapshot-interval") && hasValue)
+            settings.dentSnapshotInterval = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--telemetry") && hasValue)
+            settings.telemetryDir = argb[++i];
+        else if (!strcmp(argb[i], "--telemetry-interval") && hasValue)
+            settings.telemetryInterval = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--headless") && hasValue)
+            settings.headlessFrames = atoi(argb[++i]);
+        else if (!strcmp(argb[i], "--headless-backend") && hasValue)
+        {
+            const char* backend = argb[++i];
+                 if (!strcmp(backend, "auto"))   settings.headlessBackend = HEADLESS_AUTO;
+            else if (!strcmp(backend, "egl"))    settings.headlessBackend = HEADLESS_EGL;
+            else if (!strcmp(backend, "osmesa")) settings.headlessBackend = HEADLESS_OSMESA;
+            else
+            {
+                printUsage(argb[0]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argb[i], "--headless-output") && hasValue)
+            settings.headlessOutput = argb[++i];
+        else if (!strcmp(argb[i], "--pass-timings") && hasValue)
+            settings.passTimings = argb[++i];
+        else if (!strcmp(argb[i], "--trace") && hasValue)
+            settings.trace = argb[++i];
+        else if (!strcmp(argb[i], "--trace-events") && hasValue)
+            settings.traceEvents = atoi(argb[++i]);
+        else
+        {
+            printUsage(argb[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (settings.probeSize < 1 || settings.orbiterCount < 0 || settings.fireRate <= 0
+        || settings.shotSpread < 0 || settings.dentBudget < 1 || settings.dentMapSize < 1
+        || settings.tiledDentMap < 0 || settings.tiledDentMap % dentTileSize != 0
+        || settings.dentSnapshotInterval < 1 || settings.telemetryInterval < 1
+        || settings.headlessFrames < 0 || settings.traceEvents < 1)
+    {
+        printUsage(argb[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return settings;
+}
+
+
 int main(int argc, char* argb[])
 {
+    ProgramSettings settings = parseSettings(argc, argb);
+
+    if (settings.headlessFrames > 0)
+    {
+        HeadlessContext context;
+        initialiseHeadless(&context, settings.headlessBackend);
+        runProgram(nullptr, settings);
+        destroyHeadlessContext(&context);
+        return EXIT_SUCCESS;
+    }
+
     // Initialise window using GLFW
     GLFWwindow* window = initialise();
 
     // Run an OpenGL application using this window
-    runProgram(window);
+    runProgram(window, settings);
 
     // Terminate GLFW (no need to call glfwDestroyWindow)
     glfwTerminate();
@@ -0,0 +1,197 @@
+#include "pass_timer.hpp"
+#include "profiler.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdio>
+
+
+void createPassTimer(PassTimer* timer, bool wait){
+  for(int slot = 0; slot < passTimerLatency; slot++){
+    glCreateQueries(GL_TIMESTAMP, 2 * PASS_COUNT, &timer->queries[slot][0][0]);
+    for(int pass = 0; pass < PASS_COUNT; pass++){
+      timer->issued[slot][pass] = false;
+    }
+    timer->issuedFrame[slot] = 0;
+  }
+
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    timer->averageCpuMs[pass] = -1.0;
+    timer->averageGpuMs[pass] = -1.0;
+  }
+  timer->averageGpuFrameMs = -1.0;
+  timer->late = 0;
+  timer->wait = wait;
+
+  // The first frame is not sampled, it pays for compiling the shaders and
+  // llvmpipe reports nonsense for the first query in it
+  timer->frame = 1;
+  resetPassTimer(timer);
+  timer->frame = 0;
+}
+
+// Negative averages have no sample yet
+static void addToAverage(double* average, double sample){
+  *average = *average < 0.0 ? sample : *average + passTimerSmoothing * (sample - *average);
+}
+
+void beginPass(PassTimer* timer, FramePass pass){
+  int slot = timer->frame % passTimerLatency;
+  timer->issued[slot][pass] = true;
+  timer->issuedFrame[slot] = timer->frame;
+
+  timer->grouped[pass] = traceRecording.load(std::memory_order_relaxed);
+  if(timer->grouped[pass]){
+    pushTraceGroup(passName(pass));
+  }
+
+  glQueryCounter(timer->queries[slot][pass][0], GL_TIMESTAMP);
+  timer->passStart[pass] = std::chrono::steady_clock::now();
+}
+
+void endPass(PassTimer* timer, FramePass pass){
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> elapsed = now - timer->passStart[pass];
+  glQueryCounter(timer->queries[timer->frame % passTimerLatency][pass][1], GL_TIMESTAMP);
+
+  if(timer->grouped[pass]){
+    traceEvent(passName(pass), timer->passStart[pass], now);
+    popTraceGroup();
+  }
+
+  if(timer->frame >= timer->firstFrame){
+    timer->cpuMs[pass].push_back(elapsed.count());
+  }
+  if(timer->frame > 0){
+    addToAverage(&timer->averageCpuMs[pass], elapsed.count());
+  }
+}
+
+// Reads the timestamps of a slot. Unless wait is set, a slot that is not
+// done yet is dropped
+static void collectSlot(PassTimer* timer, int slot, bool wait){
+  bool available = true;
+  for(int pass = 0; pass < PASS_COUNT && !wait; pass++){
+    if(timer->issued[slot][pass]){
+      GLint done;
+      glGetQueryObjectiv(timer->queries[slot][pass][1], GL_QUERY_RESULT_AVAILABLE, &done);
+      available = available && done;
+    }
+  }
+
+  GLuint64 frameBegin = ~(GLuint64)0, frameEnd = 0;
+  bool sampled = false;
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    if(!timer->issued[slot][pass]){
+      continue;
+    }
+    timer->issued[slot][pass] = false;
+    if(!available){
+      continue;
+    }
+
+    GLuint64 begin, end;
+    glGetQueryObjectui64v(timer->queries[slot][pass][0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(timer->queries[slot][pass][1], GL_QUERY_RESULT, &end);
+    frameBegin = std::min(frameBegin, begin);
+    frameEnd = std::max(frameEnd, end);
+    sampled = true;
+
+    double elapsed = (end - begin) / 1000000.0;
+    if(timer->issuedFrame[slot] >= timer->firstFrame){
+      timer->gpuMs[pass].push_back(elapsed);
+    }
+    if(timer->issuedFrame[slot] > 0){
+      addToAverage(&timer->averageGpuMs[pass], elapsed);
+      traceGpuEvent(passName((FramePass)pass), begin, end);
+    }
+  }
+
+  if(!available){
+    timer->late++;
+  }else if(sampled && timer->issuedFrame[slot] > 0){
+    addToAverage(&timer->averageGpuFrameMs, (frameEnd - frameBegin) / 1000000.0);
+  }
+}
+
+void endPassTimerFrame(PassTimer* timer){
+  timer->frame++;
+  collectSlot(timer, timer->frame % passTimerLatency, timer->wait);
+}
+
+void finishPassTimer(PassTimer* timer){
+  for(int i = 1; i <= passTimerLatency; i++){
+    collectSlot(timer, (timer->frame + i) % passTimerLatency, true);
+  }
+}
+
+void resetPassTimer(PassTimer* timer){
+  timer->firstFrame = timer->frame;
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    timer->cpuMs[pass].clear();
+    timer->gpuMs[pass].clear();
+  }
+}
+
+const char* passName(FramePass pass){
+  switch(pass){
+  case PASS_PROBE:
+    return "probe";
+  case PASS_PROBE_FILTER:
+    return "probe_filter";
+  case PASS_SCENE:
+    return "scene";
+  case PASS_BALL:
+    return "ball";
+  case PASS_SHOTS:
+    return "shots";
+  case PASS_DENTS:
+    return "dents";
+  default:
+    return "unknown";
+  }
+}
+
+static double average(const std::vector<double>& samples){
+  double sum = 0.0;
+  for(unsigned int i = 0; i < samples.size(); i++){
+    sum += samples[i];
+  }
+  return samples.empty() ? 0.0 : sum / samples.size();
+}
+
+void printPassTimer(const PassTimer& timer){
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    if(!timer.cpuMs[pass].empty()){
+      printf("Pass %s: %.3f ms CPU, %.3f ms GPU on average over %d frames\n",
+	     passName((FramePass)pass), average(timer.cpuMs[pass]), average(timer.gpuMs[pass]),
+	     (int)timer.cpuMs[pass].size());
+    }
+  }
+}
+
+void dumpPassTimer(const PassTimer& timer, const std::string& filename){
+  FILE* file = stdout;
+  if(!filename.empty()){
+    file = fopen(filename.c_str(), "a");
+    if(file == NULL){
+      printf("Could not open %s for the pass timings\n", filename.c_str());
+      return;
+    }
+  }
+
+  fprintf(file, "Frame %d, rolling averages in ms (%d frames of timestamps dropped)\n", timer.frame, timer.late);
+  fprintf(file, "  %-14s %9s %9s\n", "pass", "cpu", "gpu");
+  for(int pass = 0; pass < PASS_COUNT; pass++){
+    if(timer.averageCpuMs[pass] >= 0.0){
+      fprintf(file, "  %-14s %9.3f %9.3f\n", passName((FramePass)pass),
+	      timer.averageCpuMs[pass], std::max(0.0, timer.averageGpuMs[pass]));
+    }
+  }
+  fprintf(file, "  %-14s %9s %9.3f\n", "gpu frame", "", std::max(0.0, timer.averageGpuFrameMs));
+
+  if(file != stdout){
+    fclose(file);
+  }
+}
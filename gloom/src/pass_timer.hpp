@@ -0,0 +1,83 @@
+#ifndef PASS_TIMER_HPP
+#define PASS_TIMER_HPP
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+// The parts of a frame that are timed, in the order they start. Passes may
+// nest, the probe filter runs inside the probe pass
+enum FramePass{
+  PASS_PROBE,        // Capturing the changed probe faces and filtering the mip chain
+  PASS_PROBE_FILTER, // Filtering the mip chain alone
+  PASS_SCENE,        // The main view
+  PASS_BALL,         // The reflective ball
+  PASS_SHOTS,        // Tracing the shots
+  PASS_DENTS,        // Painting the hits
+  PASS_COUNT
+};
+
+// Timestamps are double-buffered: a frame reads back the ones issued two
+// frames before, into the slot it is about to reuse
+const int passTimerLatency = 2;
+
+// Weight of a new sample in the rolling averages, about the last 32 frames
+const double passTimerSmoothing = 1.0 / 32.0;
+
+// CPU time and GPU time (from a pair of glQueryCounter timestamps) of every
+// pass in every frame. A pass that does not run in a frame has no sample.
+// Timestamps that are not available by the time their slot is reused are
+// dropped rather than waited for, except by finishPassTimer or when wait is
+// set. Dropping them skews the GPU times towards the faster frames
+struct PassTimer{
+  unsigned int queries[passTimerLatency][PASS_COUNT][2]; // Begin and end
+  bool issued[passTimerLatency][PASS_COUNT];
+  int issuedFrame[passTimerLatency]; // Frame each slot of queries was issued in
+
+  int frame;
+  int firstFrame; // Earlier frames are not sampled, nor the first one ever
+  int late;       // Frames whose timestamps were dropped
+  bool wait;      // Wait for every frame's timestamps instead, for benchmarks
+
+  std::chrono::steady_clock::time_point passStart[PASS_COUNT];
+  bool grouped[PASS_COUNT]; // Open as a debug group and trace event, see profiler.hpp
+
+  // In milliseconds, since the last reset
+  std::vector<double> cpuMs[PASS_COUNT];
+  std::vector<double> gpuMs[PASS_COUNT];
+
+  // Rolling averages in milliseconds, never reset. The GPU frame spans from
+  // the first timestamp of a frame to the last
+  double averageCpuMs[PASS_COUNT];
+  double averageGpuMs[PASS_COUNT];
+  double averageGpuFrameMs;
+};
+
+
+void createPassTimer(PassTimer* timer, bool wait);
+
+void beginPass(PassTimer* timer, FramePass pass);
+
+void endPass(PassTimer* timer, FramePass pass);
+
+// Collects the GPU times of the frame issued passTimerLatency frames ago
+void endPassTimerFrame(PassTimer* timer);
+
+// Collects the GPU times of every frame still in flight, waiting for them
+void finishPassTimer(PassTimer* timer);
+
+// Drops the samples, and those of the frames still in flight
+void resetPassTimer(PassTimer* timer);
+
+const char* passName(FramePass pass);
+
+// Average of every pass since the last reset
+void printPassTimer(const PassTimer& timer);
+
+// Appends the rolling averages to filename, or prints them when it is empty
+void dumpPassTimer(const PassTimer& timer, const std::string& filename);
+
+
+#endif
@@ -0,0 +1,130 @@
+#include "probe_scheduler.hpp"
+
+#include <algorithm>
+
+
+ProbeSchedulerSettings defaultProbeSchedulerSettings(){
+  ProbeSchedulerSettings settings;
+  settings.mode = PROBE_UPDATE_ALL;
+  settings.facesPerFrame = 2;
+  settings.maxFaceAge = 6;
+  settings.motionThreshold = 0.001f;
+  return settings;
+}
+
+void initProbeScheduler(ProbeScheduler* scheduler, const ProbeSchedulerSettings& settings){
+  scheduler->settings = settings;
+  scheduler->settings.facesPerFrame = std::max(1, std::min(6, settings.facesPerFrame));
+  scheduler->nextFace = 0;
+
+  for(int i = 0; i < 6; i++){
+    scheduler->faceAge[i] = 0;
+    scheduler->faceInvalid[i] = true;
+    scheduler->capturedBounds[i].clear();
+    scheduler->capturedLight[i] = glm::vec3(0.0f);
+  }
+}
+
+void invalidateProbe(ProbeScheduler* scheduler){
+  for(int i = 0; i < 6; i++){
+    scheduler->faceInvalid[i] = true;
+  }
+}
+
+// Movement seen by a face since its last capture. Only objects visible to
+// the face now or at capture time contribute
+static float faceMotion(const std::vector<BoundingSphere>& captured,
+			const std::vector<BoundingSphere>& bounds,
+			const Frustum& frustum){
+  float motion = 0.0f;
+  for(unsigned int i = 0; i < bounds.size(); i++){
+    if(!sphereInFrustum(frustum, bounds[i]) && !sphereInFrustum(frustum, captured[i])){
+      continue;
+    }
+
+    motion += glm::length(bounds[i].center - captured[i].center)
+      + std::abs(bounds[i].radius - captured[i].radius);
+  }
+  return motion;
+}
+
+int scheduleProbeFaces(ProbeScheduler* scheduler,
+		       const std::vector<BoundingSphere>& bounds,
+		       const glm::vec3& lightPosition,
+		       const Frustum faceFrusta[6]){
+  const ProbeSchedulerSettings& settings = scheduler->settings;
+
+  // Find the faces whose contents have changed since they were captured
+  float motion[6];
+  bool changed[6];
+  for(int i = 0; i < 6; i++){
+    if(scheduler->faceInvalid[i] || scheduler->capturedBounds[i].size() != bounds.size()){
+      motion[i] = 1e30f;
+    }else{
+      motion[i] = faceMotion(scheduler->capturedBounds[i], bounds, faceFrusta[i])
+	+ glm::length(lightPosition - scheduler->capturedLight[i]);
+    }
+    changed[i] = motion[i] > settings.motionThreshold;
+  }
+
+  int mask = 0;
+  if(settings.mode == PROBE_UPDATE_ALL){
+    for(int i = 0; i < 6; i++){
+      if(changed[i]){
+	mask |= 1 << i;
+      }
+    }
+  }else if(settings.mode == PROBE_UPDATE_ROUND_ROBIN){
+    int picked = 0;
+    for(int i = 0; i < 6 && picked < settings.facesPerFrame; i++){
+      int face = (scheduler->nextFace + i) % 6;
+      if(changed[face]){
+	mask |= 1 << face;
+	picked++;
+	scheduler->nextFace = (face + 1) % 6;
+      }
+    }
+  }else{
+    // Faces past the age limit go first, then the ones with the most motion
+    int order[6] = {0, 1, 2, 3, 4, 5};
+    std::sort(order, order + 6, [&](int a, int b){
+	bool oldA = scheduler->faceAge[a] >= settings.maxFaceAge;
+	bool oldB = scheduler->faceAge[b] >= settings.maxFaceAge;
+	if(oldA != oldB){
+	  return oldA;
+	}
+	return motion[a] > motion[b];
+      });
+
+    for(int i = 0; i < settings.facesPerFrame; i++){
+      if(changed[order[i]]){
+	mask |= 1 << order[i];
+      }
+    }
+  }
+
+  for(int i = 0; i < 6; i++){
+    if(mask & (1 << i)){
+      scheduler->capturedBounds[i] = bounds;
+      scheduler->capturedLight[i] = lightPosition;
+      scheduler->faceAge[i] = 0;
+      scheduler->faceInvalid[i] = false;
+    }else if(changed[i]){
+      scheduler->faceAge[i]++;
+    }
+  }
+
+  return mask;
+}
+
+const char* probeUpdateModeName(ProbeUpdateMode mode){
+  switch(mode){
+  case PROBE_UPDATE_ALL:
+    return "all";
+  case PROBE_UPDATE_ROUND_ROBIN:
+    return "round-robin";
+  case PROBE_UPDATE_MOTION_PRIORITY:
+    return "motion";
+  }
+  return "unknown";
+}
@@ -0,0 +1,57 @@
+#ifndef PROBE_SCHEDULER_HPP
+#define PROBE_SCHEDULER_HPP
+#pragma once
+
+#include "culling.hpp"
+
+#include <vector>
+
+
+enum ProbeUpdateMode{
+  PROBE_UPDATE_ALL,             // Every changed face, every frame
+  PROBE_UPDATE_ROUND_ROBIN,     // Changed faces in turn, facesPerFrame at a time
+  PROBE_UPDATE_MOTION_PRIORITY  // The facesPerFrame faces that have seen the most motion
+};
+
+struct ProbeSchedulerSettings{
+  ProbeUpdateMode mode;
+  int facesPerFrame;     // Upper limit on faces captured per frame in the time-sliced modes
+  int maxFaceAge;        // Frames a changed face may wait before it is captured regardless of priority
+  float motionThreshold; // Total movement (world units) a face must see before it counts as changed
+};
+
+struct ProbeScheduler{
+  ProbeSchedulerSettings settings;
+
+  int nextFace;         // Where the round robin continues
+  int faceAge[6];       // Frames each changed face has waited to be captured
+  bool faceInvalid[6];  // Set when a face must be captured regardless of motion
+
+  // Object bounds and light position at the time each face was last captured
+  std::vector<BoundingSphere> capturedBounds[6];
+  glm::vec3 capturedLight[6];
+};
+
+
+ProbeSchedulerSettings defaultProbeSchedulerSettings();
+
+void initProbeScheduler(ProbeScheduler* scheduler, const ProbeSchedulerSettings& settings);
+
+// Marks every face as changed, for changes that are neither object
+// transforms nor the light moving
+void invalidateProbe(ProbeScheduler* scheduler);
+
+// Picks the faces to capture this frame given the current object bounds and
+// light position, and returns them as a bit mask. The light lights every
+// face, so its movement counts towards the motion of all of them. A result
+// of 0 means the probe is up to date. The selected faces are assumed to be
+// captured this frame
+int scheduleProbeFaces(ProbeScheduler* scheduler,
+		       const std::vector<BoundingSphere>& bounds,
+		       const glm::vec3& lightPosition,
+		       const Frustum faceFrusta[6]);
+
+const char* probeUpdateModeName(ProbeUpdateMode mode);
+
+
+#endif
@@ -0,0 +1,139 @@
+#include "profiler.hpp"
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <mutex>
+
+
+std::atomic<bool> traceRecording(false);
+
+static std::chrono::steady_clock::time_point traceStart;
+static GLint64 gpuTraceStart; // GL_TIMESTAMP at traceStart
+static int traceCapacity;
+
+// A thread gets its buffer with its first event, named after whatever it
+// last passed to nameTraceThread. Every buffer ever made is kept so that the
+// events of threads that have exited are still written. The mutex is only
+// taken when a buffer is made
+static std::mutex bufferMutex;
+static std::vector<TraceBuffer*> buffers;
+static thread_local TraceBuffer* threadBuffer = NULL;
+static thread_local const char* threadName = "";
+
+// GPU events are recorded by the OpenGL thread, into a track of their own
+static TraceBuffer gpuBuffer;
+
+static void initTraceBuffer(TraceBuffer* buffer, int thread, const char* name){
+  buffer->events.resize(traceCapacity);
+  buffer->written.store(0, std::memory_order_relaxed);
+  buffer->thread = thread;
+  buffer->name = name;
+}
+
+static TraceBuffer* localBuffer(){
+  if(threadBuffer == NULL){
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    threadBuffer = new TraceBuffer;
+    initTraceBuffer(threadBuffer, (int)buffers.size() + 1, threadName);
+    buffers.push_back(threadBuffer);
+  }
+  return threadBuffer;
+}
+
+static void record(TraceBuffer* buffer, const TraceEvent& event){
+  uint64_t index = buffer->written.load(std::memory_order_relaxed);
+  buffer->events[index % buffer->events.size()] = event;
+  buffer->written.store(index + 1, std::memory_order_release);
+}
+
+bool startTrace(int eventsPerThread){
+#ifdef GLOOM_PROFILER
+  traceCapacity = eventsPerThread;
+  initTraceBuffer(&gpuBuffer, 0, "GPU");
+
+  glGetInteger64v(GL_TIMESTAMP, &gpuTraceStart);
+  traceStart = std::chrono::steady_clock::now();
+  traceRecording.store(true);
+  return true;
+#else
+  (void)eventsPerThread;
+  return false;
+#endif
+}
+
+void nameTraceThread(const char* name){
+  threadName = name;
+}
+
+void traceEvent(const char* name, std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end){
+  if(!traceRecording.load(std::memory_order_relaxed)){
+    return;
+  }
+
+  TraceEvent event;
+  event.name = name;
+  event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - traceStart).count();
+  event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  record(localBuffer(), event);
+}
+
+void traceGpuEvent(const char* name, uint64_t gpuBegin, uint64_t gpuEnd){
+  if(!traceRecording.load(std::memory_order_relaxed)){
+    return;
+  }
+
+  TraceEvent event;
+  event.name = name;
+  event.start = (int64_t)gpuBegin - gpuTraceStart;
+  event.duration = gpuEnd - gpuBegin;
+  record(&gpuBuffer, event);
+}
+
+void pushTraceGroup(const char* name){
+  glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void popTraceGroup(){
+  glPopDebugGroup();
+}
+
+static void writeBuffer(FILE* file, const TraceBuffer& buffer, bool* first){
+  if(!buffer.name.empty()){
+    fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+	    *first ? "" : ",", buffer.thread, buffer.name.c_str());
+    *first = false;
+  }
+
+  uint64_t written = buffer.written.load(std::memory_order_acquire);
+  uint64_t size = buffer.events.size();
+  for(uint64_t i = written > size ? written - size : 0; i < written; i++){
+    const TraceEvent& event = buffer.events[i % size];
+    fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+	    *first ? "" : ",", event.name, buffer.thread, event.start / 1000.0, event.duration / 1000.0);
+    *first = false;
+  }
+}
+
+bool writeTrace(const std::string& filename){
+  traceRecording.store(false);
+
+  FILE* file = fopen(filename.c_str(), "w");
+  if(file == NULL){
+    printf("Could not open %s for the trace\n", filename.c_str());
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  bool first = true;
+  std::lock_guard<std::mutex> lock(bufferMutex);
+  for(unsigned int i = 0; i < buffers.size(); i++){
+    writeBuffer(file, *buffers[i], &first);
+  }
+  writeBuffer(file, gpuBuffer, &first);
+  fprintf(file, "\n]}\n");
+
+  fclose(file);
+  return true;
+}
@@ -0,0 +1,98 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+#pragma once
+
+// Scoped CPU profiler that writes Chrome trace event JSON, for chrome://tracing
+// or Perfetto. Scopes are only compiled in with GLOOM_PROFILER defined, and
+// then cost a relaxed atomic load until a trace is started. Each thread
+// records into its own ring buffer, so recording takes no lock; a full ring
+// keeps the latest events
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+struct TraceEvent{
+  const char* name; // Must outlive the trace, in practice a string literal
+  int64_t start;    // Nanoseconds since the trace started
+  int64_t duration;
+};
+
+// Written by one thread only, and read once recording has stopped
+struct TraceBuffer{
+  std::vector<TraceEvent> events;
+  std::atomic<uint64_t> written; // Ever, the ring holds the last events.size()
+  int thread;
+  std::string name;
+};
+
+extern std::atomic<bool> traceRecording;
+
+
+// Starts recording, with room for eventsPerThread events in every thread.
+// GPU events are placed on the CPU timeline with an offset measured here,
+// so the OpenGL context must be current. False when the profiler was not
+// compiled in
+bool startTrace(int eventsPerThread);
+
+// Stops recording and writes what was recorded. Threads still running
+// must not be in a scope
+bool writeTrace(const std::string& filename);
+
+// Shown in place of the thread number, call before the first event
+void nameTraceThread(const char* name);
+
+void traceEvent(const char* name, std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point end);
+
+// On the track of the GPU, with begin and end from GL_TIMESTAMP queries
+void traceGpuEvent(const char* name, uint64_t gpuBegin, uint64_t gpuEnd);
+
+// Scope that is also a debug group, for the OpenGL thread. Debug groups
+// show up in frame debuggers such as RenderDoc and apitrace
+void pushTraceGroup(const char* name);
+
+void popTraceGroup();
+
+
+struct ProfileScope{
+  const char* name;
+  bool active;
+  bool group;
+  std::chrono::steady_clock::time_point start;
+
+  ProfileScope(const char* name, bool group)
+    : name(name), active(traceRecording.load(std::memory_order_relaxed)), group(group && active){
+    if(this->group){
+      pushTraceGroup(name);
+    }
+    if(active){
+      start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ProfileScope(){
+    if(active){
+      traceEvent(name, start, std::chrono::steady_clock::now());
+    }
+    if(group){
+      popTraceGroup();
+    }
+  }
+};
+
+#ifdef GLOOM_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, false)
+#define PROFILE_GPU_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, true)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#endif
+
+
+#endif
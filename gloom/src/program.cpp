@@ -10,18 +10,33 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "broadphase.hpp"
 #include "camera.hpp"
+#include "collision.hpp"
+#include "culling.hpp"
+#include "dent_journal.hpp"
+#include "dent_tiles.hpp"
+#include "dents.hpp"
+#include "frame_uniforms.hpp"
+#include "gl_debug.hpp"
+#include "indirect.hpp"
+#include "profiler.hpp"
+#include "readback.hpp"
+#include "resources.hpp"
+#include "sphere_surface.hpp"
 
 #ifdef __linux__
 #include <unistd.h>
 #endif
 
 #include <algorithm>
+#include <vector>
 
 #define PE() {printf("OpenGL Error at %s, line %d?\n", __FILE__, __LINE__); printGLError();printf("End\n");}
 
 unsigned int createObjectVAO(const RenderObject& object);
 void computeTangentAndBitangent(RenderObject& object);
+void computeBoundingRadius(RenderObject& object);
 
 void createCubeObject(RenderObject* object){
   object->numVertices = 4 * 6; // No shared vertices, to keep normals consistent
@@ -60,6 +75,7 @@ void createCubeObject(RenderObject* object){
   }
 
   computeTangentAndBitangent(*object);
+  computeBoundingRadius(*object);
   
   object->vao = createObjectVAO(*object);
 }
@@ -120,24 +136,18 @@ void createSphereObject(RenderObject* object, float size, int resolution){
   // And now to generate the vertices:
 
   for(int i = 0; i < resolution - 1; i++){
-    float verticalAngle = (M_PI * (i + 1)) / resolution - M_PI / 2;
-    float ch = cos(verticalAngle);
     for(int j = 0; j < resolution + 1; j++){
-      float horizontalAngle = 2 * M_PI * j / resolution;
-      object->normals[3 * (i * (resolution + 1) + j) + 0] = ch * sin(horizontalAngle);
-      object->normals[3 * (i * (resolution + 1) + j) + 1] = sin(verticalAngle);
-      object->normals[3 * (i * (resolution + 1) + j) + 2] = ch * cos(horizontalAngle);
-
-      // Calculate vertices as size * normals
-      object->vertices[3 * (i * (resolution + 1) + j) + 0] =
-	size * object->normals[3 * (i * (resolution + 1) + j) + 0];
-      object->vertices[3 * (i * (resolution + 1) + j) + 1] =
-	size * object->normals[3 * (i * (resolution + 1) + j) + 1];
-      object->vertices[3 * (i * (resolution + 1) + j) + 2] =
-	size * object->normals[3 * (i * (resolution + 1) + j) + 2];
-
-      object->uvs[2 * (i * (resolution + 1) + j) + 0] = ((float)j) / resolution;
-      object->uvs[2 * (i * (resolution + 1) + j) + 1] = ((float)(i + 1)) / resolution;
+      float u = ((float)j) / resolution;
+      float v = ((float)(i + 1)) / resolution;
+      SurfacePoint point = sphereSurfacePoint(u, v, size);
+
+      for(int k = 0; k < 3; k++){
+	object->normals[3 * (i * (resolution + 1) + j) + k] = point.normal[k];
+	object->vertices[3 * (i * (resolution + 1) + j) + k] = point.position[k];
+      }
+
+      object->uvs[2 * (i * (resolution + 1) + j) + 0] = u;
+      object->uvs[2 * (i * (resolution + 1) + j) + 1] = v;
     }
   }
 
@@ -168,6 +178,7 @@ void createSphereObject(RenderObject* object, float size, int resolution){
   // Compute tangents and bitangents (duh)
 
   computeTangentAndBitangent(*object);
+  computeBoundingRadius(*object);
   
   // Create VAO
   
@@ -185,37 +196,8 @@ void destroyRenderObject(RenderObject* object){
   delete[] object->indices;
 }
 
-unsigned int createVAO(int numArrays, int numElems, float** arrays, int* sizes, int numIndices, unsigned int* indices){
-  unsigned int vao;
-  glGenVertexArrays(1, &vao);
-
-  glBindVertexArray(vao);
-
-  const int maxvbos = 16;
-  if(numArrays > maxvbos){
-    printf("Too many arrays sent to createVAO (sent %d, max is %d)\n", numArrays, maxvbos);
-    exit(-1);
-  }
-  unsigned int vbos[maxvbos];
-  glGenBuffers(numArrays, vbos);
-
-  for(int i = 0; i < numArrays; i++){
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
-
-    glBufferData(GL_ARRAY_BUFFER, sizes[i] * numElems * sizeof(float), arrays[i], GL_STATIC_DRAW);
-
-    glVertexAttribPointer(i, sizes[i], GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(i);
-  }
-
-  unsigned int indexBuffer;
-  glGenBuffers(1, &indexBuffer);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indices, GL_STATIC_DRAW);
-
-  return vao;
-}
+// Chosen at startup with --packed-vertices, applies to every VAO
+bool packedVertices = false;
 
 void computeTangentAndBitangent(RenderObject& object){
   float* t = new float[object.numVertices * 3];
@@ -309,123 +291,100 @@ void computeTangentAndBitangent(RenderObject& object){
   object.bitangents = b;
 }
 
-unsigned int createVAOPosAndTex(int numElems, float* vertices, float* coords, int numIndices, unsigned int* indices){
-  float* arrays[] = {vertices, coords};
-  int sizes[] = {3, 2};
-  return createVAO(2, numElems, arrays, sizes, numIndices, indices);
-}
+void computeBoundingRadius(RenderObject& object){
+  float maxsq = 0.0f;
+  for(unsigned int i = 0; i < object.numVertices; i++){
+    float sqsum = 0.0f;
+    for(int j = 0; j < 3; j++){
+      sqsum += object.vertices[3 * i + j] * object.vertices[3 * i + j];
+    }
+    maxsq = std::max(maxsq, sqsum);
+  }
 
-unsigned int createVAOPosTexNormal(int numElems, float* vertices, float* coords, float* normals, int numIndices, unsigned int* indices){
-  float* arrays[] = {vertices, coords, normals};
-  int sizes[] = {3, 2, 3};
-  return createVAO(3, numElems, arrays, sizes, numIndices, indices);
+  object.boundingRadius = sqrt(maxsq);
 }
 
 unsigned int createObjectVAO(const RenderObject& object){
+  if(packedVertices){
+    return createPackedVAO(object.numVertices, object.vertices, object.uvs, object.normals,
+			   object.tangents, object.bitangents, object.numIndices, object.indices);
+  }
+
   float* arrays[] = {object.vertices, object.uvs, object.normals, object.tangents, object.bitangents};
   int sizes[] = {3, 2, 3, 3, 3};
   return createVAO(5, object.numVertices, arrays, sizes, object.numIndices, object.indices);
 }
 
-unsigned int createTexture(std::string filename, unsigned int* width = 0, unsigned int* height = 0){
-  PNGImage image = loadPNGFile(filename);
-
-  unsigned int texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-	       image.width, image.height, 0,
-	       GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, image.pixels.data());
-  glGenerateMipmap(GL_TEXTURE_2D);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  if(width != 0){
-    *width = image.width;
+// Packs the objects into one shared set of vertex and index buffers, so the
+// whole scene can be drawn from a single VAO. Each object's offsets into
+// the buffers are stored in its firstIndex and baseVertex
+unsigned int createSceneGeometry(RenderObject** objects, int count){
+  std::vector<float> vertices, uvs, normals, tangents, bitangents;
+  std::vector<unsigned int> indices;
+
+  for(int i = 0; i < count; i++){
+    RenderObject& object = *objects[i];
+    object.baseVertex = vertices.size() / 3;
+    object.firstIndex = indices.size();
+
+    vertices.insert(vertices.end(), object.vertices, object.vertices + 3 * object.numVertices);
+    uvs.insert(uvs.end(), object.uvs, object.uvs + 2 * object.numVertices);
+    normals.insert(normals.end(), object.normals, object.normals + 3 * object.numVertices);
+    tangents.insert(tangents.end(), object.tangents, object.tangents + 3 * object.numVertices);
+    bitangents.insert(bitangents.end(), object.bitangents, object.bitangents + 3 * object.numVertices);
+    indices.insert(indices.end(), object.indices, object.indices + object.numIndices);
   }
-  
-  if(height != 0){
-    *height = image.height;
-  }
-  
-  return texture;
-}
-
-// If textureFile is non-zero, width and height are ignored
-unsigned int createCubeMapTexture(int size, std::string* textureFile = 0){
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE); 
-  
-  if(textureFile){
-    PNGImage image = loadPNGFile(*textureFile);
-    if(image.height != image.width){
-      puts((std::string("Texture ") + *textureFile + std::string(" did not have equal width and height, which are required for cubemap\n")).c_str());
-    }
-
-    for(int i = 0; i < 6; i++){
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
-		   image.width, image.height, 0,
-		   GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, image.pixels.data());
-    }
-  }else{
-    for(int i = 0; i < 6; i++){
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
-		   size, size, 0,
-		   GL_RGBA, GL_FLOAT, NULL);
-    }
+  if(packedVertices){
+    return createPackedVAO(vertices.size() / 3, vertices.data(), uvs.data(), normals.data(),
+			   tangents.data(), bitangents.data(), indices.size(), indices.data());
   }
 
-  
-  return textureID;
+  float* arrays[] = {vertices.data(), uvs.data(), normals.data(), tangents.data(), bitangents.data()};
+  int sizes[] = {3, 2, 3, 3, 3};
+  return createVAO(5, vertices.size() / 3, arrays, sizes, indices.size(), indices.data());
 }
 
-unsigned int createFramebuffer(int width, int height){
-  unsigned int framebuffer;
-  glGenFramebuffersEXT(1, &framebuffer);
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-  unsigned int depthbuffer;
-  glGenRenderbuffersEXT(1, &depthbuffer);
-  glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
-  
-  return framebuffer;
-}
+// Fills the mip chain of a probe cube map after a capture. Either a plain
+// box-filtered chain, or one where each level is a cone blur of the level
+// above, for sampling by roughness
+void updateProbeMipmaps(unsigned int texture, int size, Gloom::Shader* prefilterShader){
+  PROFILE_GPU_SCOPE("updateProbeMipmaps");
+  if(!prefilterShader){
+    glGenerateTextureMipmap(texture);
+    return;
+  }
 
-void createCubeFrameBuffer(int size, unsigned int* framebuffer, unsigned int* colorTexture){
-  glGenTextures(1, colorTexture);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, *colorTexture);
-  glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glUseProgram(prefilterShader->get());
+  glBindTextureUnit(0, texture);
 
-  for(int i = 0; i < 6; i++){
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
-		 size, size, 0, GL_RGBA, GL_FLOAT, NULL);
-  }
+  int levels = mipLevelCount(size);
+  for(int level = 1; level < levels; level++){
+    int levelSize = std::max(1, size >> level);
 
-  *framebuffer = createFramebuffer(size, size);
+    prefilterShader->setUniform("sourceLevel", level - 1);
+    // About two destination texels, in units of the face tangent plane
+    prefilterShader->setUniform("spread", 4.0f / levelSize);
+    glBindImageTexture(0, texture, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
 
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-			 GL_TEXTURE_CUBE_MAP_POSITIVE_X, *colorTexture, 0);
+    glDispatchCompute((levelSize + 7) / 8, (levelSize + 7) / 8, 6);
 
+    // The next level samples this one
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+}
 
-  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
-    printf("Incomplete framebuffer!\n");
-    exit(-1);
+// Returns true only on the frame where the key goes from released to pressed
+bool keyPressedOnce(GLFWwindow* window, int key){
+  if(window == NULL){
+    return false;
   }
+
+  static bool wasPressed[GLFW_KEY_LAST + 1] = {false};
+  bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+  bool result = pressed && !wasPressed[key];
+  wasPressed[key] = pressed;
+  return result;
 }
 
 std::string vstr(glm::vec3 vec){
@@ -434,59 +393,153 @@ std::string vstr(glm::vec3 vec){
   return std::string(buff);
 }
 
+// Seconds per frame without a window, so headless runs always see the same frames
+const float headlessTimestep = 1.0f / 60.0f;
+
 RenderObject cubeObject;
 RenderObject sphereObject;
-unsigned int uniformModel;
 const float ball_radius = 1.0f;
 
-unsigned int normalTexture;
+NormalMaps normalMaps;
 Gloom::Shader* normalTextureChangeShader;
-unsigned int normal_texture_framebuffer;
-unsigned int normal_texture_size;
 
 glm::mat4 view;
 
+ImpactQueue impactQueue;
+std::vector<glm::vec3> frameImpacts; // Hits painted this frame
+Gloom::Shader* dentShader;
+// Toggled with N, otherwise every hit re-rasterizes the whole sphere
+bool computeDents = true;
+
+// Used instead of the normal maps with --tiled-dent-map
+bool tiledDents;
+DentTiles dentTiles;
+Gloom::Shader* tiledDentShader;
+
+// With --dent-journal, every painted hit is journaled to keep the dents across runs
+bool journalDents;
+DentJournal dentJournal;
+// Most journaled hits repainted in one dispatch when starting
+const int replayBatch = 1024;
+
+// With --telemetry, the normal map and the probe are exported as PNGs
+bool telemetry;
+ReadbackRing telemetryRing;
+PngWriter pngWriter;
+std::vector<ReadbackImage> readbackImages; // Finished this frame
+// Each export takes up to seven slots, this keeps three of them in flight
+const int telemetrySlots = 21;
+const int maxQueuedPngs = 64;
+
 void changeNormals(glm::vec3 collision){
-  glBindTexture(GL_TEXTURE_2D, normalTexture);
   glUseProgram(normalTextureChangeShader->get());
-  unsigned int collisionUniform = glGetUniformLocation(normalTextureChangeShader->get(), "collisionPoint");
-  unsigned int textureSizeUniform = glGetUniformLocation(normalTextureChangeShader->get(), "texture_size");
+  normalTextureChangeShader->setUniform("collisionPoint", collision);
 
-  glUniform3f(collisionUniform, collision.x, collision.y, collision.z);
-  glUniform1f(textureSizeUniform, (float)normal_texture_size);
+  // Every texel is rewritten, so the back copy needs no catching up
+  normalMaps.staleRegions.clear();
 
-  glBindFramebuffer(GL_FRAMEBUFFER, normal_texture_framebuffer);
-  glViewport(0, 0, normal_texture_size, normal_texture_size); // Oh boy
-  glBindVertexArray(sphereObject.vao);
+  glBindFramebuffer(GL_FRAMEBUFFER, normalMaps.framebuffers[1 - normalMaps.front]);
+  glViewport(0, 0, normalMaps.size, normalMaps.size); // Oh boy
+  glBindVertexArray(normalMaps.fullscreenVao);
   glDisable(GL_DEPTH_TEST);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-			 GL_TEXTURE_2D, normalTexture, 0);
-  glBindTextureUnit(0, normalTexture);
+  glBindTextureUnit(0, frontNormalMap(normalMaps));
+  glBindTextureUnit(1, normalMaps.surface);
   
-  glDrawElements(GL_TRIANGLES,
-		 sphereObject.numIndices,
-		 GL_UNSIGNED_INT, 0);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
   glEnable(GL_DEPTH_TEST);
+
+  DentRegion changed = dentRegion(collision, ball_radius, normalMaps.size);
+  swapNormalMaps(&normalMaps, &changed, 1);
 }
 
-void shoot(const glm::vec3& position, const glm::vec3& direction){
-  glm::vec3 dr = -position; // Ball center - position
+// Deviates direction by a random angle of up to spread radians
+glm::vec3 spreadDirection(const glm::vec3& direction, float spread){
+  if(spread <= 0.0f){
+    return direction;
+  }
 
-  glm::vec3 q = glm::cross(dr, direction);
-  float absq = glm::length(q);
-  if(absq > ball_radius){;
+  glm::vec3 up = fabs(direction.y) < 0.999f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+  glm::vec3 side = glm::normalize(glm::cross(up, direction));
+  glm::vec3 across = glm::cross(direction, side);
+
+  float angle = 2 * M_PI * rand() / RAND_MAX;
+  float deviation = spread * sqrt((float)rand() / RAND_MAX);
+  return glm::normalize(direction + tanf(deviation) * (cosf(angle) * side + sinf(angle) * across));
+}
+
+// Dents the normal map around the queued hits, as many as the budget allows
+void applyDents(){
+  PROFILE_GPU_SCOPE("applyDents");
+  takeImpacts(&impactQueue, &frameImpacts);
+  if(frameImpacts.empty()){
     return;
   }
-  
-  float k = sqrt(ball_radius * ball_radius - absq * absq);
-  float l = glm::dot(direction, dr);
-  if(l < 0){
+
+  if(journalDents){
+    for(unsigned int i = 0; i < frameImpacts.size(); i++){
+      journalImpact(&dentJournal, frameImpacts[i]);
+    }
+    flushDentJournal(&dentJournal);
+  }
+
+  if(tiledDents){
+    paintDentTiles(*tiledDentShader, &dentTiles, ball_radius, &impactQueue.buffer,
+		   frameImpacts.data(), frameImpacts.size());
+  }else if(computeDents){
+    paintDents(*dentShader, &normalMaps, ball_radius, &impactQueue.buffer,
+	       frameImpacts.data(), frameImpacts.size());
+  }else{
+    for(unsigned int i = 0; i < frameImpacts.size(); i++){
+      changeNormals(frameImpacts[i]);
+    }
+  }
+}
+
+// Repaints the hits journaled after the snapshot the normal map started from
+void replayDentJournal(){
+  std::vector<glm::vec3> collisions;
+  readDentJournal(dentJournal, dentJournal.snapshotRecords, &collisions);
+
+  for(unsigned int first = 0; first < collisions.size(); first += replayBatch){
+    int count = std::min<int>(replayBatch, collisions.size() - first);
+    if(tiledDents){
+      paintDentTiles(*tiledDentShader, &dentTiles, ball_radius, &impactQueue.buffer,
+		     collisions.data() + first, count);
+    }else{
+      paintDents(*dentShader, &normalMaps, ball_radius, &impactQueue.buffer,
+		 collisions.data() + first, count);
+    }
+  }
+
+  printf("Dent journal: %ld hits, %ld from the snapshot, %d replayed\n",
+	 dentJournal.records, dentJournal.snapshotRecords, (int)collisions.size());
+}
+
+// Snapshots the dense normal map when enough hits were journaled since the last one
+void snapshotDents(bool force){
+  PROFILE_SCOPE("snapshotDents");
+  if(!journalDents || tiledDents){
     return;
   }
+  if(dentSnapshotDue(dentJournal) || (force && dentJournal.records > dentJournal.snapshotRecords)){
+    writeDentSnapshot(&dentJournal, normalMaps);
+  }
+}
 
-  glm::vec3 collision_point = position + direction * (l - k);
+// Queues readbacks of the normal map and the probe faces, to be written to dir
+void requestTelemetry(const std::string& dir, int framenum, unsigned int probe, int probeSize){
+  PROFILE_GPU_SCOPE("requestTelemetry");
+  char name[64];
+  if(!tiledDents){
+    snprintf(name, sizeof(name), "/dents_%06d.png", framenum);
+    requestReadback(&telemetryRing, frontNormalMap(normalMaps), 0,
+		    normalMaps.size, normalMaps.size, dir + name, framenum);
+  }
 
-  changeNormals(collision_point);
+  for(int face = 0; face < 6; face++){
+    snprintf(name, sizeof(name), "/probe_%06d_%d.png", framenum, face);
+    requestReadback(&telemetryRing, probe, face, probeSize, probeSize, dir + name, framenum);
+  }
 }
 
 
@@ -494,38 +547,404 @@ void drawObject(const RenderObject& object){
   glDrawElements(GL_TRIANGLES, object.numIndices, GL_UNSIGNED_INT, 0);
 }
 
-void renderScene(float count){
-  int program;
+// An object placed in the world for the current frame
+struct SceneObject{
+  const RenderObject* object;
+  glm::mat4 model;
+  BoundingSphere bounds; // In world space, covering all instances
+
+  // If non-zero, the object is drawn instanced with model matrices taken
+  // from the instance buffer bound to its VAO (or instanceModels when
+  // drawing indirectly), and model is unused
+  unsigned int instanceCount;
+  const glm::mat4* instanceModels;
+};
+
+std::vector<SceneObject> scene;
+CullingStats probeCullingStats;
+
+// Bounds of every individual object, including each instance
+std::vector<BoundingSphere> sceneBounds;
+
+std::vector<glm::mat4> orbiterModels;
+StreamBuffer orbiterInstanceBuffer;
+
+// Vertex buffer binding of the per-instance model matrices
+const int instanceBinding = 5;
+
+// Creates a buffer of per-instance model matrices, read by attribute
+// locations 5-8 of the given VAO
+void createInstanceBuffer(unsigned int vao, StreamBuffer* buffer){
+  // Start with one matrix so the attributes never read outside the buffer
+  glm::mat4 identity(1.0f);
+  createStreamBuffer(buffer, sizeof(glm::mat4));
+  uploadStreamBuffer(buffer, glm::value_ptr(identity), sizeof(glm::mat4));
+
+  glVertexArrayVertexBuffer(vao, instanceBinding, buffer->buffer, 0, sizeof(glm::mat4));
+  glVertexArrayBindingDivisor(vao, instanceBinding, 1);
+
+  for(int i = 0; i < 4; i++){
+    glVertexArrayAttribFormat(vao, 5 + i, 4, GL_FLOAT, GL_FALSE, i * sizeof(glm::vec4));
+    glVertexArrayAttribBinding(vao, 5 + i, instanceBinding);
+    glEnableVertexArrayAttrib(vao, 5 + i);
+  }
+}
 
-  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+void addSceneObject(const RenderObject& object, const glm::mat4& model){
+  SceneObject sceneObject;
+  sceneObject.object = &object;
+  sceneObject.model = model;
+  sceneObject.bounds = transformBoundingSphere(model, object.boundingRadius);
+  sceneObject.instanceCount = 0;
+  sceneObject.instanceModels = 0;
+  scene.push_back(sceneObject);
+  sceneBounds.push_back(sceneObject.bounds);
+}
 
-  glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, 0));
-  uniformModel = glGetUniformLocation(program, "model");
-  
-  glBindVertexArray(sphereObject.vao);
+// Places the orbiting spheres and the floor cube for the given time. When
+// instanced, all orbiters become a single object drawn from orbiterInstanceBuffer
+void updateScene(float count, int orbiterCount, bool instanced){
+  PROFILE_SCOPE("updateScene");
+  scene.clear();
+  sceneBounds.clear();
+  orbiterModels.resize(orbiterCount);
 
-  for(int i = 0 ; i < 4; i++){
-    float theta = count + i * M_PI / 2;
+  for(int i = 0 ; i < orbiterCount; i++){
+    float theta = count + i * 2 * M_PI / orbiterCount;
     glm::vec3 translation = glm::vec3(sin(theta), cos(2.1329 * theta) * 0.2f, cos(theta));
-    model = glm::translate(glm::mat4(1.0f), 4.0f * translation); 
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    glDrawElements(GL_TRIANGLES,
-		   sphereObject.numIndices,
-		   GL_UNSIGNED_INT, 0);  
+    orbiterModels[i] = glm::translate(glm::mat4(1.0f), 4.0f * translation);
+
+    if(!instanced){
+      addSceneObject(sphereObject, orbiterModels[i]);
+    }
+  }
+
+  if(instanced && orbiterCount > 0){
+    SceneObject orbiters;
+    orbiters.object = &sphereObject;
+    orbiters.model = glm::mat4(1.0f);
+    orbiters.instanceCount = orbiterCount;
+    orbiters.instanceModels = orbiterModels.data();
+    orbiters.bounds.center = glm::vec3(0.0f);
+    orbiters.bounds.radius = 0.0f;
+
+    for(int i = 0; i < orbiterCount; i++){
+      BoundingSphere bounds = transformBoundingSphere(orbiterModels[i], sphereObject.boundingRadius);
+      orbiters.bounds.radius = std::max(orbiters.bounds.radius, glm::length(bounds.center) + bounds.radius);
+      sceneBounds.push_back(bounds);
+    }
+
+    scene.push_back(orbiters);
+
+    if(uploadStreamBuffer(&orbiterInstanceBuffer, orbiterModels.data(), orbiterCount * sizeof(glm::mat4))){
+      glVertexArrayVertexBuffer(sphereObject.vao, instanceBinding, orbiterInstanceBuffer.buffer, 0, sizeof(glm::mat4));
+    }
+  }
+
+  addSceneObject(cubeObject,
+		 glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, -8, 0)), glm::vec3(5, 5, 5)));
+}
+
+// Shots fired this frame, all tested at once by resolveShots
+RayBatch shots;
+std::vector<RayHit> shotHits;
+
+// Everything a shot can hit: the ball first, then the orbiters, which
+// stop shots but are not dented
+SphereBatch shotTargets;
+SphereBvh shotTargetBvh;
+BroadphaseStats broadphaseStats;
+// Toggled with B, otherwise every shot is tested against every target
+bool shotBroadphase = true;
+
+void shoot(const glm::vec3& position, const glm::vec3& direction){
+  PROFILE_SCOPE("shoot");
+  addRay(&shots, position, direction);
+}
+
+// Moves the shot targets to where the scene has placed the orbiters
+void updateShotTargets(int orbiterCount){
+  PROFILE_SCOPE("updateShotTargets");
+  clearSpheres(&shotTargets);
+  addSphere(&shotTargets, glm::vec3(0.0f), ball_radius);
+
+  for(int i = 0; i < orbiterCount; i++){
+    BoundingSphere bounds = transformBoundingSphere(orbiterModels[i], sphereObject.boundingRadius);
+    addSphere(&shotTargets, bounds.center, bounds.radius);
+  }
+
+  updateSphereBvh(&shotTargetBvh, shotTargets);
+}
+
+// Queues a dent for every shot that hit the ball
+void resolveShots(){
+  PROFILE_SCOPE("resolveShots");
+  if(rayCount(shots) == 0){
+    return;
+  }
+
+  if(shotBroadphase){
+    queryRays(shotTargetBvh, shotTargets, shots, &shotHits, &broadphaseStats);
+  }else{
+    intersectRays(shots, shotTargets, &shotHits);
+  }
+
+  for(unsigned int i = 0; i < shotHits.size(); i++){
+    if(shotHits[i].sphere == 0){
+      queueImpact(&impactQueue, shotHits[i].point);
+    }
+  }
+
+  clearRays(&shots);
+}
+
+// Uniforms the scene shaders set per draw, looked up once after linking
+struct SceneUniforms{
+  Gloom::Shader::Uniform instanced;
+  Gloom::Shader::Uniform model;
+  Gloom::Shader::Uniform indirect;
+  Gloom::Shader::Uniform faceMask; // Layered shader only
+};
+
+SceneUniforms sceneUniforms(Gloom::Shader& shader){
+  SceneUniforms uniforms;
+  uniforms.instanced = shader.handle("instanced");
+  uniforms.model = shader.handle("model");
+  uniforms.indirect = shader.handle("indirect");
+  uniforms.faceMask = shader.handle("faceMask");
+  return uniforms;
+}
+
+void drawSceneObject(Gloom::Shader& shader, const SceneUniforms& uniforms, const SceneObject& sceneObject){
+  if(sceneObject.instanceCount > 0){
+    shader.setUniform(uniforms.instanced, 1);
+    glDrawElementsInstanced(GL_TRIANGLES, sceneObject.object->numIndices,
+			    GL_UNSIGNED_INT, 0, sceneObject.instanceCount);
+  }else{
+    shader.setUniform(uniforms.instanced, 0);
+    shader.setUniform(uniforms.model, sceneObject.model);
+    drawObject(*sceneObject.object);
+  }
+}
+
+// Returns false if the object is entirely outside the frustum, if one is
+// given. Counted in probeCullingStats for face
+bool isSceneObjectVisible(const SceneObject& sceneObject, const Frustum* frustum, int face){
+  if(frustum && !sphereInFrustum(*frustum, sceneObject.bounds)){
+    if(face >= 0){
+      probeCullingStats.culled[face]++;
+    }
+    return false;
+  }
+
+  if(face >= 0){
+    probeCullingStats.drawn[face]++;
+  }
+  return true;
+}
+
+// The subset of probeFaces the object can be seen from, when frusta are given
+int layeredFaceMask(const SceneObject& sceneObject, int probeFaces, const Frustum* faceFrusta){
+  if(!faceFrusta){
+    return probeFaces;
+  }
+
+  int faceMask = 0;
+  for(int face = 0; face < 6; face++){
+    if(!(probeFaces & (1 << face))){
+      continue;
+    }
+
+    if(sphereInFrustum(faceFrusta[face], sceneObject.bounds)){
+      faceMask |= 1 << face;
+      probeCullingStats.drawn[face]++;
+    }else{
+      probeCullingStats.culled[face]++;
+    }
+  }
+  return faceMask;
+}
+
+// Indirect submission: the whole scene lives in one VAO, and each pass is a
+// single glMultiDrawElementsIndirect over its own segment of commands
+bool indirectSubmission = true;
+unsigned int sceneVao;
+IndirectDraws indirectDraws;
+DrawSegment mainSegment;
+DrawSegment layeredSegment;
+DrawSegment faceSegments[6];
+
+void addIndirectCommand(const SceneObject& sceneObject, int firstObject){
+  DrawElementsIndirectCommand command;
+  command.count = sceneObject.object->numIndices;
+  command.instanceCount = std::max(1u, sceneObject.instanceCount);
+  command.firstIndex = sceneObject.object->firstIndex;
+  command.baseVertex = sceneObject.object->baseVertex;
+  command.baseInstance = firstObject;
+  indirectDraws.commands.push_back(command);
+}
+
+// Builds and uploads the commands of every pass for this frame. Culling
+// happens here rather than at draw time
+void buildIndirectScene(int probeFaces, const Frustum* faceFrusta, bool layered){
+  PROFILE_GPU_SCOPE("buildIndirectScene");
+  clearIndirectDraws(&indirectDraws);
+
+  // Object data is shared by all segments
+  std::vector<int> firstObject(scene.size());
+  for(unsigned int i = 0; i < scene.size(); i++){
+    const SceneObject& sceneObject = scene[i];
+    if(sceneObject.instanceCount > 0){
+      firstObject[i] = addIndirectObjects(&indirectDraws, sceneObject.instanceModels,
+					  sceneObject.instanceCount);
+    }else{
+      firstObject[i] = addIndirectObjects(&indirectDraws, &sceneObject.model, 1);
+    }
+  }
+
+  mainSegment = beginDrawSegment(indirectDraws);
+  for(unsigned int i = 0; i < scene.size(); i++){
+    addIndirectCommand(scene[i], firstObject[i]);
+  }
+  endDrawSegment(indirectDraws, &mainSegment);
+
+  // Segments of the probe path not taken stay empty
+  layeredSegment = beginDrawSegment(indirectDraws);
+  for(int face = 0; face < 6; face++){
+    faceSegments[face] = beginDrawSegment(indirectDraws);
+  }
+
+  if(layered){
+    for(unsigned int i = 0; i < scene.size(); i++){
+      int faceMask = layeredFaceMask(scene[i], probeFaces, faceFrusta);
+      if(faceMask == 0){
+	continue;
+      }
+
+      int objectCount = std::max(1u, scene[i].instanceCount);
+      for(int j = 0; j < objectCount; j++){
+	indirectDraws.objects[firstObject[i] + j].faceMask = faceMask;
+      }
+      addIndirectCommand(scene[i], firstObject[i]);
+    }
+    endDrawSegment(indirectDraws, &layeredSegment);
+  }else{
+    for(int face = 0; face < 6; face++){
+      faceSegments[face] = beginDrawSegment(indirectDraws);
+      if(probeFaces & (1 << face)){
+	for(unsigned int i = 0; i < scene.size(); i++){
+	  if(isSceneObjectVisible(scene[i], faceFrusta ? &faceFrusta[face] : 0, face)){
+	    addIndirectCommand(scene[i], firstObject[i]);
+	  }
+	}
+      }
+      endDrawSegment(indirectDraws, &faceSegments[face]);
+    }
+  }
+
+  uploadIndirectDraws(&indirectDraws, sceneVao);
+}
+
+// Draws the scene with shader, which must be active, and its sceneUniforms. If a
+// frustum is given, objects entirely outside it are skipped and counted in
+// probeCullingStats for face
+void renderScene(Gloom::Shader& shader, const SceneUniforms& uniforms,
+		 const Frustum* frustum = 0, int face = -1){
+  PROFILE_GPU_SCOPE("renderScene");
+  shader.setUniform(uniforms.indirect, (GLint)indirectSubmission);
+  if(indirectSubmission){
+    // Already culled when the commands were built
+    glBindVertexArray(sceneVao);
+    drawIndirectSegment(face >= 0 ? faceSegments[face] : mainSegment);
+    return;
+  }
+
+  unsigned int boundVao = 0;
+  for(unsigned int i = 0; i < scene.size(); i++){
+    const SceneObject& sceneObject = scene[i];
+
+    if(!isSceneObjectVisible(sceneObject, frustum, face)){
+      continue;
+    }
+
+    if(sceneObject.object->vao != boundVao){
+      boundVao = sceneObject.object->vao;
+      glBindVertexArray(boundVao);
+    }
+
+    drawSceneObject(shader, uniforms, sceneObject);
+  }
+}
+
+// Draws the scene once for the faces of the layered probe selected by
+// probeFaces. Faces an object cannot be seen from are masked off in the
+// geometry shader, and objects outside every face are not submitted at all
+void renderSceneLayered(Gloom::Shader& shader, const SceneUniforms& uniforms,
+			int probeFaces, const Frustum* faceFrusta = 0){
+  PROFILE_GPU_SCOPE("renderSceneLayered");
+  shader.setUniform(uniforms.indirect, (GLint)indirectSubmission);
+  if(indirectSubmission){
+    glBindVertexArray(sceneVao);
+    drawIndirectSegment(layeredSegment);
+    return;
+  }
+
+  unsigned int boundVao = 0;
+  for(unsigned int i = 0; i < scene.size(); i++){
+    const SceneObject& sceneObject = scene[i];
+
+    int faceMask = layeredFaceMask(sceneObject, probeFaces, faceFrusta);
+    if(faceMask == 0){
+      continue;
+    }
+
+    if(sceneObject.object->vao != boundVao){
+      boundVao = sceneObject.object->vao;
+      glBindVertexArray(boundVao);
+    }
+
+    shader.setUniform(uniforms.faceMask, faceMask);
+    drawSceneObject(shader, uniforms, sceneObject);
   }
+}
 
-  model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, -8, 0)), glm::vec3(5, 5, 5));
-  glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-  glBindVertexArray(cubeObject.vao);
-  glDrawElements(GL_TRIANGLES,
-		 cubeObject.numIndices,
-		 GL_UNSIGNED_INT, 0);
+ProgramSettings defaultProgramSettings(){
+  ProgramSettings settings;
+  settings.probeScheduler = defaultProbeSchedulerSettings();
+  settings.probeSize = 256;
+  settings.probePrefilter = false;
+  settings.orbiterCount = 4;
+  settings.packedVertices = false;
+  settings.fireRate = 1.0f;
+  settings.shotSpread = 0.0f;
+  settings.dentBudget = 64;
+  settings.dentMapSize = 512;
+  settings.tiledDentMap = 0;
+  settings.dentSnapshotInterval = 4096;
+  settings.telemetryInterval = 60;
+  settings.headlessFrames = 0;
+  settings.headlessBackend = HEADLESS_AUTO;
+  settings.traceEvents = 1 << 16;
+  settings.script = NULL;
+  return settings;
 }
 
-void runProgram(GLFWwindow* window)
+void runProgram(GLFWwindow* window, const ProgramSettings& settings)
 {
-  int width, height;
-  glfwGetFramebufferSize(window, &width, &height);
+  // Errors are reported as they happen, rather than polled for every frame
+  enableGLDebugOutput();
+
+  int width = windowWidth, height = windowHeight;
+  unsigned int screenFramebuffer = 0, screenTexture = 0;
+  if(window){
+    glfwGetFramebufferSize(window, &width, &height);
+  }else{
+    // Stands in for the window's default framebuffer
+    screenFramebuffer = createFramebuffer(width, height);
+    glCreateTextures(GL_TEXTURE_2D, 1, &screenTexture);
+    glTextureStorage2D(screenTexture, 1, GL_RGBA8, width, height);
+    glNamedFramebufferTexture(screenFramebuffer, GL_COLOR_ATTACHMENT0, screenTexture, 0);
+  }
   
   // Enable depth (Z) buffer (accept "closest" fragment)
   glEnable(GL_DEPTH_TEST);
@@ -534,6 +953,9 @@ void runProgram(GLFWwindow* window)
   // Configure miscellaneous OpenGL settings
   glEnable(GL_CULL_FACE);
 
+  // Let the blurred probe mip levels filter across cube map faces
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
   // Set default colour after clearing the colour buffer
   glClearColor(0.3f, 0.5f, 0.8f, 1.0f);
 
@@ -544,21 +966,44 @@ void runProgram(GLFWwindow* window)
   GlCamera camera;
 
   unsigned int texture = createTexture("../gloom/src/gloom/diamond.png");
-  normalTexture = createTexture("../gloom/src/pics/flat_normals.png", &normal_texture_size);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  journalDents = !settings.dentJournal.empty();
+  if(journalDents){
+    openDentJournal(&dentJournal, settings.dentJournal, settings.dentSnapshotInterval);
+  }
+
+  // Snapshots only hold the dense map, the tiled one replays the whole journal
+  tiledDents = settings.tiledDentMap > 0;
+  if(tiledDents){
+    createDentTiles(&dentTiles, settings.tiledDentMap, ball_radius);
+  }else if(journalDents && loadDentSnapshot(&dentJournal, &normalMaps, ball_radius)){
+    printf("Dent map restored from %s.snapshot\n", settings.dentJournal.c_str());
+  }else if(!settings.dentMapFile.empty()){
+    loadNormalMaps(&normalMaps, settings.dentMapFile, ball_radius);
+  }else{
+    createNormalMaps(&normalMaps, settings.dentMapSize, ball_radius);
+  }
   
   glBindTextureUnit(0, texture);
     
+  packedVertices = settings.packedVertices;
   createSphereObject(&sphereObject, ball_radius, 50);
 
   createCubeObject(&cubeObject);
+
+  createInstanceBuffer(sphereObject.vao, &orbiterInstanceBuffer);
+  // Toggled with I
+  bool instancedOrbiters = true;
+
+  RenderObject* sceneObjects[] = {&sphereObject, &cubeObject};
+  sceneVao = createSceneGeometry(sceneObjects, 2);
+  createIndirectDraws(&indirectDraws);
    
   Gloom::Shader shader;
   Gloom::Shader reflectionShader;
 
   // For shooting projectiles
-  const float originalCooldown = 1.0f;
   float cooldown = 0.0f;
+  createImpactQueue(&impactQueue, settings.dentBudget);
   
     
   shader.makeBasicShader("../gloom/shaders/lighting.vert",
@@ -566,35 +1011,63 @@ void runProgram(GLFWwindow* window)
 
   reflectionShader.makeBasicShader("../gloom/shaders/reflection.vert",
 				   "../gloom/shaders/reflection.frag");
+  const SceneUniforms shaderUniforms = sceneUniforms(shader);
+  const Gloom::Shader::Uniform reflectionModel = reflectionShader.handle("model");
+  const Gloom::Shader::Uniform reflectionRoughness = reflectionShader.handle("prefilteredRoughness");
+  const Gloom::Shader::Uniform reflectionMaxLod = reflectionShader.handle("probeMaxLod");
 
   Gloom::Shader normalTextureChangeShaderObj;
   normalTextureChangeShader = &normalTextureChangeShaderObj;
   normalTextureChangeShader->makeBasicShader("../gloom/shaders/normal_changing.vert",
 				      "../gloom/shaders/normal_changing.frag");
 
-    
-  unsigned int uniformLightPosition = glGetUniformLocation(shader.get(), "lightPosition");
+  Gloom::Shader dentShaderObj;
+  dentShader = &dentShaderObj;
+  dentShader->attach("../gloom/shaders/dent.comp");
+  dentShader->link();
+
+  Gloom::Shader tiledDentShaderObj;
+  tiledDentShader = &tiledDentShaderObj;
+  tiledDentShader->attach("../gloom/shaders/dent_tiled.comp");
+  tiledDentShader->link();
+
+  if(journalDents){
+    replayDentJournal();
+  }
+
+  reflectionShader.setUniform("packedVertices", (GLint)packedVertices);
+  reflectionShader.setUniform("tiledNormals", (GLint)tiledDents);
+
+  // Renders all six cube map faces in one pass
+  Gloom::Shader layeredShader;
+  layeredShader.attach("../gloom/shaders/lighting_layered.vert");
+  layeredShader.attach("../gloom/shaders/lighting_layered.geom");
+  layeredShader.attach("../gloom/shaders/lighting.frag");
+  layeredShader.link();
+  const SceneUniforms layeredUniforms = sceneUniforms(layeredShader);
 
-  unsigned int uniformView = glGetUniformLocation(shader.get(), "view");
-  unsigned int uniformProjection = glGetUniformLocation(shader.get(), "projection");
+    
   
   unsigned int cube_framebuffer, cube_texture;
-  createCubeFrameBuffer(256, &cube_framebuffer, &cube_texture);
-
-  normal_texture_framebuffer = createFramebuffer(normal_texture_size, normal_texture_size);
-  glBindFramebuffer(GL_FRAMEBUFFER, normal_texture_framebuffer);
-  glBindTexture(GL_TEXTURE_2D, normalTexture);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-			 GL_TEXTURE_2D, normalTexture, 0);
+  const int probeSize = settings.probeSize;
+  createCubeFrameBuffer(probeSize, &cube_framebuffer, &cube_texture);
+
+  telemetry = !settings.telemetryDir.empty();
+  if(telemetry){
+    int largest = std::max(probeSize, tiledDents ? 0 : normalMaps.size);
+    createReadbackRing(&telemetryRing, telemetrySlots, 4 * (size_t)largest * largest);
+    startPngWriter(&pngWriter, maxQueuedPngs);
+  }
 
     
-  unsigned int model_reflection_uniform = glGetUniformLocation(reflectionShader.get(), "model");
-  unsigned int view_reflection_uniform = glGetUniformLocation(reflectionShader.get(), "view");
-  unsigned int projection_reflection_uniform = glGetUniformLocation(reflectionShader.get(), "projection");
+  Gloom::Shader probePrefilterShader;
+  probePrefilterShader.attach("../gloom/shaders/probe_prefilter.comp");
+  probePrefilterShader.link();
 
-  unsigned int light_position_reflection_uniform = glGetUniformLocation(reflectionShader.get(), "lightPosition");
+  // Toggled with R
+  bool probePrefilter = settings.probePrefilter;
     
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
 
   glm::mat4 rotArray[6];
   for(int i = 0; i < 6; i++){
@@ -620,15 +1093,59 @@ void runProgram(GLFWwindow* window)
 
   rotArray[5][2][2] = -1.0f;
   rotArray[5][0][0] = -1.0f;
+
+  // Probe projection, flipped to match the cube map face orientation
+  glm::mat4 probeProjection = glm::perspective(M_PI / 2, 1.0, 0.01, 100.0);
+  probeProjection = glm::translate(glm::scale(probeProjection, 1.f * glm::vec3(-1.f, -1.f, 1.f)),
+				   glm::vec3(-.0f, -.0f, 0.0f));
+
+  // The face views never change, so the layered shader gets them once
+  unsigned int layered_cube_framebuffer, cube_depth_texture;
+  createLayeredCubeFrameBuffer(probeSize, cube_texture, &layered_cube_framebuffer, &cube_depth_texture);
+  createProbeViewsBuffer(rotArray);
+  glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+
+  Frustum faceFrusta[6];
+  for(int i = 0; i < 6; i++){
+    faceFrusta[i] = extractFrustum(probeProjection * rotArray[i]);
+  }
+
+  FrameUniformBuffer frameUniformBuffer;
+  createFrameUniformBuffer(&frameUniformBuffer);
+
+  // Toggled with L; the per-face path is kept as a fallback
+  bool layeredProbe = true;
+  // Toggled with C
+  bool probeCulling = true;
+
+  // Decides which faces need to be captured each frame, mode cycled with P
+  ProbeScheduler probeScheduler;
+  initProbeScheduler(&probeScheduler, settings.probeScheduler);
+
+  // CPU and GPU time of each pass, printed every 500 frames unless a script
+  // times them. A script gets the time of every frame, however late
+  PassTimer ownTimer;
+  PassTimer* timer = settings.script && settings.script->timer ? settings.script->timer : &ownTimer;
+  createPassTimer(timer, timer != &ownTimer);
+  std::vector<ScriptedShot> scriptedShots;
     
+  if(!settings.trace.empty()){
+    if(startTrace(settings.traceEvents)){
+      nameTraceThread("main");
+    }else{
+      printf("Built without GLOOM_PROFILER, not tracing\n");
+    }
+  }
+
   // Rendering Loop
   float count = 0;
   int framenum = 0;
     
-  while (!glfwWindowShouldClose(window))
+  while (window ? !glfwWindowShouldClose(window) : framenum < settings.headlessFrames)
     {
+      PROFILE_SCOPE("frame");
       framenum++;
-      float deltaTime = getTimeDeltaSeconds();
+      float deltaTime = window ? getTimeDeltaSeconds() : headlessTimestep;
       
       // Draw your scene here
       glUseProgram(shader.get());
@@ -637,105 +1154,313 @@ void runProgram(GLFWwindow* window)
 
       float theta = count;
       glm::vec3 lightPosition = 5.0f * glm::vec3(sin(theta), 1.5f, cos(theta));
-      glUniform3f(uniformLightPosition, lightPosition.x, lightPosition.y, lightPosition.z);
-      
+
+      glm::mat4 projection = glm::perspective(M_PI / 3, 4./3.,
+					      0.01, 100.0);
+      {
+	PROFILE_SCOPE("updateCameraTransform");
+	view = window ? updateCameraTransform(window) : cameraTransform();
+      }
+      scriptedShots.clear();
+      if(settings.script){
+	settings.script->frame(framenum, count, &view, &scriptedShots);
+      }
+
+      // Camera and light state for the main view and every probe face, sent in one upload
+      FrameUniforms frameUniforms;
+      frameUniforms.view = view;
+      frameUniforms.projection = projection;
+      frameUniforms.lightPosition = glm::vec4(lightPosition, 1.0f);
+      setFrameUniforms(&frameUniformBuffer, mainViewSlot, frameUniforms);
+
+      frameUniforms.projection = probeProjection;
+      for(int i = 0; i < 6; i++){
+	frameUniforms.view = rotArray[i];
+	setFrameUniforms(&frameUniformBuffer, probeFaceSlot + i, frameUniforms);
+      }
+      uploadFrameUniforms(&frameUniformBuffer);
+
       // Render from middle instance
-      glm::mat4 projection = glm::perspective(M_PI / 2, 1.0, 0.01, 100.0);
-      projection = glm::translate(glm::scale(projection, 1.f * glm::vec3(-1.f, -1.f, 1.f)),
-				  glm::vec3(-.0f, -.0f, 0.0f));
+      if(keyPressedOnce(window, GLFW_KEY_I)){
+	instancedOrbiters = !instancedOrbiters;
+	printf("Orbiter instancing %s\n", instancedOrbiters ? "enabled" : "disabled");
+      }
 
-      glUseProgram(shader.get());
-      glBindFramebuffer(GL_FRAMEBUFFER, cube_framebuffer);
-      glViewport(0, 0, 256, 256);
+      updateScene(count, settings.orbiterCount, instancedOrbiters);
+      updateShotTargets(settings.orbiterCount);
+
+      if(keyPressedOnce(window, GLFW_KEY_C)){
+	probeCulling = !probeCulling;
+	printf("Probe culling %s\n", probeCulling ? "enabled" : "disabled");
+      }
+
+      if(keyPressedOnce(window, GLFW_KEY_L)){
+	printPassTimer(*timer);
+	resetPassTimer(timer);
+	layeredProbe = !layeredProbe;
+	printf("Switched to %s probe rendering\n", layeredProbe ? "layered" : "per-face");
+      }
+
+      if(keyPressedOnce(window, GLFW_KEY_P)){
+	ProbeSchedulerSettings schedulerSettings = probeScheduler.settings;
+	schedulerSettings.mode = (ProbeUpdateMode)((schedulerSettings.mode + 1) % 3);
+	initProbeScheduler(&probeScheduler, schedulerSettings);
+	printf("Probe update mode: %s\n", probeUpdateModeName(schedulerSettings.mode));
+      }
+
+      int probeFaces;
+      {
+	PROFILE_SCOPE("scheduleProbeFaces");
+	probeFaces = scheduleProbeFaces(&probeScheduler, sceneBounds, lightPosition, faceFrusta);
+      }
 
-      glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projection));
-      glBindTexture(GL_TEXTURE_2D, texture);
       glBindTextureUnit(0, texture);
 
+      resetCullingStats(&probeCullingStats);
+
+      if(keyPressedOnce(window, GLFW_KEY_M)){
+	indirectSubmission = !indirectSubmission;
+	printf("Indirect scene submission %s\n", indirectSubmission ? "enabled" : "disabled");
+      }
+
+      if(indirectSubmission){
+	buildIndirectScene(probeFaces, probeCulling ? faceFrusta : 0, layeredProbe);
+      }
+
+      if(probeFaces != 0){
+	beginPass(timer, PASS_PROBE);
+      }
+
+      if(probeFaces == 0){
+	// Nothing has changed since the last capture
+      }else if(layeredProbe){
+	// All selected faces in a single submission
+	glUseProgram(layeredShader.get());
+	bindFrameUniforms(frameUniformBuffer, probeFaceSlot);
+	glBindFramebuffer(GL_FRAMEBUFFER, layered_cube_framebuffer);
+	glViewport(0, 0, probeSize, probeSize);
+
+	if(probeFaces == 0x3f){
+	  glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	}else{
+	  // A layered clear would wipe every face, so only clear the selected ones
+	  const float clearColor[] = {0.3f, 0.5f, 0.8f, 1.0f};
+	  const float clearDepth = 1.0f;
+	  for(int i = 0; i < 6; i++){
+	    if(probeFaces & (1 << i)){
+	      glClearTexSubImage(cube_texture, 0, 0, 0, i, probeSize, probeSize, 1,
+				 GL_RGBA, GL_FLOAT, clearColor);
+	      glClearTexSubImage(cube_depth_texture, 0, 0, 0, i, probeSize, probeSize, 1,
+				 GL_DEPTH_COMPONENT, GL_FLOAT, &clearDepth);
+	    }
+	  }
+	}
+
+	renderSceneLayered(layeredShader, layeredUniforms, probeFaces, probeCulling ? faceFrusta : 0);
+      }else{
+	glUseProgram(shader.get());
+	glBindFramebuffer(GL_FRAMEBUFFER, cube_framebuffer);
+	glViewport(0, 0, probeSize, probeSize);
       
-      // Render once for each rotation
+	// Render once for each rotation
       
-      for(int i = 0; i < 6; i++){
-	view = rotArray[i];
-	
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(view));
-	
+	for(int i = 0; i < 6; i++){
+	  if(!(probeFaces & (1 << i))){
+	    continue;
+	  }
+
+	  bindFrameUniforms(frameUniformBuffer, probeFaceSlot + i);
 	
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-	 		       GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-	 		       cube_texture,
-	 		       0);
+	  glNamedFramebufferTextureLayer(cube_framebuffer, GL_COLOR_ATTACHMENT0, cube_texture, 0, i);
 
-	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	  glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 		
 	
-	renderScene(count);
+	  renderScene(shader, shaderUniforms, probeCulling ? &faceFrusta[i] : 0, i);
+
+	}
+      }
 
+      if(keyPressedOnce(window, GLFW_KEY_R)){
+	probePrefilter = !probePrefilter;
+	printf("Probe roughness prefiltering %s\n", probePrefilter ? "enabled" : "disabled");
+	invalidateProbe(&probeScheduler);
+      }
+
+      if(probeFaces != 0){
+	beginPass(timer, PASS_PROBE_FILTER);
+	updateProbeMipmaps(cube_texture, probeSize, probePrefilter ? &probePrefilterShader : 0);
+	endPass(timer, PASS_PROBE_FILTER);
+	endPass(timer, PASS_PROBE);
+      }
+
+      if(keyPressedOnce(window, GLFW_KEY_T)){
+	dumpPassTimer(*timer, settings.passTimings);
+      }
+
+      if(framenum % 500 == 0){
+	if(timer == &ownTimer){
+	  printPassTimer(ownTimer);
+	  resetPassTimer(&ownTimer);
+	}
+	printCullingStats(probeCullingStats);
+	printImpactQueue(impactQueue);
+	if(tiledDents){
+	  printDentTiles(dentTiles);
+	}
+	printBroadphaseStats(broadphaseStats, shotTargetBvh);
+	printGLDebugSummary();
+	resetBroadphaseStats(&broadphaseStats);
+	if(telemetry){
+	  printReadbackStats(telemetryRing, &pngWriter);
+	}
       }
 	
       // Render from viewpoint
       
-      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      beginPass(timer, PASS_SCENE);
+      glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
       glViewport(0, 0, width, height);
       
       // Clear colour and depth buffers
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
       
       glUseProgram(shader.get());
-      projection = glm::perspective(M_PI / 3, 4./3.,
-				    0.01, 100.0);
-      view = updateCameraTransform(window);
-	
-      glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(view));
-      glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projection));
+      bindFrameUniforms(frameUniformBuffer, mainViewSlot);
 
-      renderScene(count);
+      renderScene(shader, shaderUniforms);
+      endPass(timer, PASS_SCENE);
 
       // Render the reflective ball 
       
+      beginPass(timer, PASS_BALL);
       glUseProgram(reflectionShader.get());
-      glBindTexture(GL_TEXTURE_CUBE_MAP, cube_texture);
       glBindTextureUnit(0, cube_texture);
-
-      glBindTexture(GL_TEXTURE_2D, normalTexture);
-      glBindTextureUnit(1, normalTexture);
+      if(tiledDents){
+	// The tile arrays are replaced when they grow
+	glBindTextureUnit(2, dentTiles.pageTable);
+	glBindTextures(3, dentTileArrays, dentTiles.tiles);
+      }else{
+	glBindTextureUnit(1, frontNormalMap(normalMaps));
+      }
       glBindVertexArray(sphereObject.vao);
 
       glm::mat4 model(1.0f);
-      glUniformMatrix4fv(model_reflection_uniform, 1, GL_FALSE, glm::value_ptr(model));
-      glUniformMatrix4fv(view_reflection_uniform, 1, GL_FALSE, glm::value_ptr(view));
-      glUniformMatrix4fv(projection_reflection_uniform, 1, GL_FALSE, glm::value_ptr(projection));
-
-      glUniform3f(light_position_reflection_uniform, lightPosition.x, lightPosition.y, lightPosition.z);
+      reflectionShader.setUniform(reflectionModel, model);
+      reflectionShader.setUniform(reflectionRoughness, (GLint)probePrefilter);
+      reflectionShader.setUniform(reflectionMaxLod, (float)(mipLevelCount(probeSize) - 1));
       
       glDrawElements(GL_TRIANGLES, sphereObject.numIndices, GL_UNSIGNED_INT, 0);
+      endPass(timer, PASS_BALL);
+
+      // Projectile "shooting", every shot due since the last frame is fired
+      cooldown -= deltaTime;
+      if(window && glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS){
+	glm::vec3 shotOrigin = - glm::transpose(glm::mat3(view)) *  glm::vec3(view[3]);
+	glm::vec3 shotDirection = glm::transpose(glm::mat3(view)) * glm::vec3(0.0, 0.0, -1.0);
+	while(cooldown <= 0){
+	  shoot(shotOrigin, spreadDirection(shotDirection, settings.shotSpread));
+	  cooldown += 1.0f / settings.fireRate;
+	}
+      }else{
+	cooldown = std::max(0.0f, cooldown);
+      }
+      for(unsigned int i = 0; i < scriptedShots.size(); i++){
+	shoot(scriptedShots[i].origin, scriptedShots[i].direction);
+      }
+
+      if(keyPressedOnce(window, GLFW_KEY_B)){
+	shotBroadphase = !shotBroadphase;
+	printf("Shot broadphase %s\n", shotBroadphase ? "enabled" : "disabled");
+      }
 
-      // Projectile "shooting"
-      cooldown = std::max(0.0f, cooldown - deltaTime);
-      if(
-	 (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && cooldown == 0)){
-	shoot( - glm::transpose(glm::mat3(view)) *  glm::vec3(view[3]),
-	       glm::transpose(glm::mat3(view)) * glm::vec3(0.0, 0.0, -1.0));
-	cooldown = originalCooldown;
+      if(!tiledDents && keyPressedOnce(window, GLFW_KEY_N)){
+	computeDents = !computeDents;
+	printf("Compute shader dent painting %s\n", computeDents ? "enabled" : "disabled");
+      }
+
+      beginPass(timer, PASS_SHOTS);
+      resolveShots();
+      endPass(timer, PASS_SHOTS);
+      beginPass(timer, PASS_DENTS);
+      applyDents();
+      endPass(timer, PASS_DENTS);
+      snapshotDents(false);
+
+      if(telemetry){
+	PROFILE_SCOPE("telemetry");
+	if(framenum % settings.telemetryInterval == 0){
+	  requestTelemetry(settings.telemetryDir, framenum, cube_texture, probeSize);
+	}
+	pollReadbacks(&telemetryRing, framenum, &readbackImages);
+	for(unsigned int i = 0; i < readbackImages.size(); i++){
+	  writePng(&pngWriter, &readbackImages[i]);
+	}
       }
 	
+      endPassTimerFrame(timer);
+      if(settings.script && settings.script->frameEnd){
+	settings.script->frameEnd(framenum);
+      }
+
+      if(window == NULL){
+	continue;
+      }
+
       // Handle other events
-      glfwPollEvents();
-      handleKeyboardInput(window);
+      {
+	PROFILE_SCOPE("glfwPollEvents");
+	glfwPollEvents();
+	handleKeyboardInput(window);
+      }
 
       // Flip buffers
-      glfwSwapBuffers(window);
+      {
+	PROFILE_SCOPE("glfwSwapBuffers");
+	glfwSwapBuffers(window);
+      }
 
-      // In case something has happened
-      printGLError();
-      
 #ifdef __linux__
       // Let the poor CPU and GPU rest
-      usleep(10000);
-      glfwPollEvents();
+      {
+	PROFILE_SCOPE("usleep");
+	usleep(10000);
+	glfwPollEvents();
+      }
 #endif
       
     }
+
+  finishPassTimer(timer);
+  printGLDebugSummary();
+  if(!settings.passTimings.empty()){
+    dumpPassTimer(*timer, settings.passTimings);
+  }
+
+  if(window == NULL && !settings.headlessOutput.empty()){
+    ReadbackImage image;
+    image.name = settings.headlessOutput;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(4 * width * height);
+    glGetTextureImage(screenTexture, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.size(), image.pixels.data());
+    encodePng(&image);
+  }
+
+  if(journalDents){
+    snapshotDents(true);
+    closeDentJournal(&dentJournal);
+  }
+
+  // Readbacks still in flight are abandoned, the ones already read are written
+  if(telemetry){
+    stopPngWriter(&pngWriter);
+  }
+
+  // After the PNG writer has stopped, so no thread is still in a scope
+  if(!settings.trace.empty() && traceRecording){
+    writeTrace(settings.trace);
+  }
 }
 
 
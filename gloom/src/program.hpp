@@ -6,56 +6,80 @@
 // System headers
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 #include <string>
+#include <vector>
 
+// Local headers
+#include "headless.hpp"
+#include "pass_timer.hpp"
+#include "probe_scheduler.hpp"
 
-// Main OpenGL program
-void runProgram(GLFWwindow* window);
 
+struct ScriptedShot{
+  glm::vec3 origin;
+  glm::vec3 direction;
+};
 
-// Function for handling keypresses
-void handleKeyboardInput(GLFWwindow* window);
+// Drives the program in place of the input, for benchmarks. frame is called
+// at the start of every frame with the time since the start, sets the view
+// and adds the shots to fire. frameEnd, if set, is called once the frame has
+// been submitted, the last one included. Passes are timed into timer when it
+// is set, which runProgram creates, waiting for the timestamps of every
+// frame rather than dropping late ones, but leaves to the script to reset
+struct ProgramScript{
+  void (*frame)(int framenum, float time, glm::mat4* view, std::vector<ScriptedShot>* shots);
+  void (*frameEnd)(int framenum);
+  PassTimer* timer;
+};
+
+// Options given on the command line
+struct ProgramSettings{
+  ProbeSchedulerSettings probeScheduler;
+
+  int probeSize;       // Side length of the cube map faces
+  bool probePrefilter; // Blur the probe mip chain for rough (dented) regions
 
+  int orbiterCount;    // Number of spheres orbiting the reflective ball
 
-// Checks for whether an OpenGL error occurred. If one did,
-// it prints out the error type and ID
-inline void printGLError() {
-  int errorID = glGetError();
-
-  if(errorID != GL_NO_ERROR) {
-    std::string errorString;
-
-    switch(errorID) {
-    case GL_INVALID_ENUM:
-      errorString = "GL_INVALID_ENUM";
-      break;
-    case GL_INVALID_OPERATION:
-      errorString = "GL_INVALID_OPERATION";
-      break;
-    case GL_INVALID_FRAMEBUFFER_OPERATION:
-      errorString = "GL_INVALID_FRAMEBUFFER_OPERATION";
-      break;
-    case GL_OUT_OF_MEMORY:
-      errorString = "GL_OUT_OF_MEMORY";
-      break;
-    case GL_STACK_UNDERFLOW:
-      errorString = "GL_STACK_UNDERFLOW";
-      break;
-    case GL_STACK_OVERFLOW:
-      errorString = "GL_STACK_OVERFLOW";
-      break;
-    case GL_INVALID_VALUE:
-      errorString = "GL_INVALID_VALUE";
-      break;
-    default:
-      errorString = "[Unknown error ID]";
-      break;
-    }
-
-    fprintf(stderr, "An OpenGL error occurred (%i): %s.\n",
-	    errorID, errorString.c_str());
-  }
-}
+  bool packedVertices; // Interleaved, compressed vertex format for all objects
+
+  float fireRate;      // Shots per second while SPACE is held
+  float shotSpread;    // Random deviation of each shot, in radians
+  int dentBudget;      // Most hits painted into the normal map per frame
+  int dentMapSize;     // Of the dense normal map, which starts flat
+  std::string dentMapFile; // Dent state to start from instead, sets the size
+  int tiledDentMap;    // Size of the sparse tiled normal map, 0 for the dense one
+  std::string dentJournal; // Keeps the dents across runs when set, see dent_journal.hpp
+  int dentSnapshotInterval; // Journaled hits between snapshots of the normal map
+
+  std::string telemetryDir; // Export the normal map and probe here when set
+  int telemetryInterval;    // Frames between exports
+
+  std::string trace;         // Chrome trace of the CPU and GPU scopes, when set and built with GLOOM_PROFILER
+  int traceEvents;           // Kept per thread, older ones are overwritten
+
+  std::string passTimings;  // T dumps the pass timings here, or to stdout when empty. Also at exit when set
+
+  int headlessFrames;       // Render this many frames without a window, 0 for a window
+  HeadlessBackend headlessBackend;
+  std::string headlessOutput; // PNG of the last headless frame, when set
+
+  const ProgramScript* script; // Not on the command line, NULL unless benchmarking
+};
+
+
+// The settings without any command line options
+ProgramSettings defaultProgramSettings();
+
+
+// Main OpenGL program. Without a window it renders settings.headlessFrames
+// frames into a framebuffer object, at a fixed timestep and without input
+void runProgram(GLFWwindow* window, const ProgramSettings& settings);
+
+
+// Function for handling keypresses
+void handleKeyboardInput(GLFWwindow* window);
 
 
 struct RenderObject{
@@ -71,6 +95,13 @@ struct RenderObject{
   uint32_t numVertices;
   uint32_t numIndices;
 
+  // Radius of an origin-centered sphere enclosing all vertices
+  float boundingRadius;
+
+  // Where the object starts in the shared scene geometry
+  uint32_t firstIndex;
+  int32_t baseVertex;
+
   unsigned int vao;
 };
 
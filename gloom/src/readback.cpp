@@ -0,0 +1,171 @@
+#include "readback.hpp"
+#include "gl_debug.hpp"
+#include "profiler.hpp"
+#include "resources.hpp"
+
+#include "gloom/lodepng.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+
+void createReadbackRing(ReadbackRing* ring, int slots, size_t slotSize){
+  ring->slots.resize(slots);
+  for(int i = 0; i < slots; i++){
+    ring->slots[i].buffer = createBuffer(slotSize, NULL, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT);
+    ring->slots[i].fence = 0;
+  }
+
+  ring->slotSize = slotSize;
+  ring->first = 0;
+  ring->inFlight = 0;
+  ring->completed = 0;
+  ring->skipped = 0;
+  ring->failed = 0;
+  ring->latencyFrames = 0;
+}
+
+bool requestReadback(ReadbackRing* ring, unsigned int texture, int layer,
+		     int width, int height, std::string name, int frame){
+  size_t bytes = 4 * (size_t)width * height;
+  if(ring->inFlight == (int)ring->slots.size() || bytes > ring->slotSize){
+    ring->skipped++;
+    return false;
+  }
+
+  ReadbackSlot& slot = ring->slots[(ring->first + ring->inFlight) % ring->slots.size()];
+  slot.image.name = name;
+  slot.image.width = width;
+  slot.image.height = height;
+  slot.image.frame = frame;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  glGetTextureSubImage(texture, 0, 0, 0, layer, width, height, 1,
+		       GL_RGBA, GL_UNSIGNED_BYTE, bytes, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  ring->inFlight++;
+  return true;
+}
+
+void pollReadbacks(ReadbackRing* ring, int frame, std::vector<ReadbackImage>* images){
+  images->clear();
+
+  while(ring->inFlight > 0){
+    ReadbackSlot& slot = ring->slots[ring->first];
+
+    // A zero timeout only asks, the flush makes sure the fence gets there
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(status == GL_TIMEOUT_EXPIRED){
+      break;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    if(status == GL_WAIT_FAILED){
+      // The copy may never have happened, so the pixels cannot be trusted
+      reportGLError("Waiting for a readback fence failed, the readback is dropped");
+      ring->failed++;
+      ring->first = (ring->first + 1) % ring->slots.size();
+      ring->inFlight--;
+      continue;
+    }
+
+    size_t bytes = 4 * (size_t)slot.image.width * slot.image.height;
+    slot.image.pixels.resize(bytes);
+    const void* mapped = glMapNamedBufferRange(slot.buffer, 0, bytes, GL_MAP_READ_BIT);
+    memcpy(slot.image.pixels.data(), mapped, bytes);
+    glUnmapNamedBuffer(slot.buffer);
+
+    ring->completed++;
+    ring->latencyFrames += frame - slot.image.frame;
+    images->push_back(ReadbackImage());
+    std::swap(images->back(), slot.image);
+
+    ring->first = (ring->first + 1) % ring->slots.size();
+    ring->inFlight--;
+  }
+}
+
+bool encodePng(ReadbackImage* image){
+  // PNG rows go from the top down
+  size_t row = 4 * image->width;
+  for(int y = 0; y < image->height / 2; y++){
+    std::swap_ranges(image->pixels.begin() + y * row, image->pixels.begin() + (y + 1) * row,
+		     image->pixels.begin() + (image->height - 1 - y) * row);
+  }
+
+  unsigned error = lodepng::encode(image->name, image->pixels, image->width, image->height);
+  if(error){
+    printf("Could not write %s: %s\n", image->name.c_str(), lodepng_error_text(error));
+  }
+  return error == 0;
+}
+
+static void encodePngs(PngWriter* writer){
+  nameTraceThread("png writer");
+  std::unique_lock<std::mutex> lock(writer->mutex);
+
+  while(true){
+    writer->wake.wait(lock, [writer]{ return !writer->queued.empty() || writer->stopping; });
+    if(writer->queued.empty()){
+      return;
+    }
+
+    ReadbackImage image;
+    std::swap(image, writer->queued.front());
+    writer->queued.pop_front();
+    lock.unlock();
+
+    bool written;
+    {
+      PROFILE_SCOPE("encodePng");
+      written = encodePng(&image);
+    }
+
+    lock.lock();
+    if(written){
+      writer->written++;
+    }
+  }
+}
+
+void startPngWriter(PngWriter* writer, int maxQueued){
+  writer->maxQueued = maxQueued;
+  writer->stopping = false;
+  writer->written = 0;
+  writer->dropped = 0;
+  writer->worker = std::thread(encodePngs, writer);
+}
+
+void writePng(PngWriter* writer, ReadbackImage* image){
+  {
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    if((int)writer->queued.size() >= writer->maxQueued){
+      writer->dropped++;
+      return;
+    }
+    writer->queued.push_back(ReadbackImage());
+    std::swap(writer->queued.back(), *image);
+  }
+  writer->wake.notify_one();
+}
+
+void stopPngWriter(PngWriter* writer){
+  {
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    writer->stopping = true;
+  }
+  writer->wake.notify_one();
+  writer->worker.join();
+}
+
+void printReadbackStats(const ReadbackRing& ring, PngWriter* writer){
+  std::lock_guard<std::mutex> lock(writer->mutex);
+  printf("Readback: %d completed (%.1f frames late on average), %d skipped, %d failed, %d in flight; "
+	 "%d written, %d waiting, %d dropped\n",
+	 ring.completed, ring.completed > 0 ? (double)ring.latencyFrames / ring.completed : 0.0,
+	 ring.skipped, ring.failed, ring.inFlight, writer->written, (int)writer->queued.size(), writer->dropped);
+}
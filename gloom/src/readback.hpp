@@ -0,0 +1,84 @@
+#ifndef READBACK_HPP
+#define READBACK_HPP
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// RGBA8 image read back from a texture, bottom row first as OpenGL stores it
+struct ReadbackImage{
+  std::string name; // Where it should end up, chosen by whoever requested it
+  int width, height;
+  int frame;        // Requested in
+  std::vector<unsigned char> pixels;
+};
+
+struct ReadbackSlot{
+  unsigned int buffer; // Pixel pack buffer the texture is copied into
+  GLsync fence;        // Signals once the copy is done
+  ReadbackImage image; // Everything but the pixels until then
+};
+
+// Ring of pixel pack buffers that textures are copied into without waiting
+// for the GPU. The copies finish in order, and pollReadbacks picks up the
+// ones whose fence has signalled, usually a few frames later. A request
+// that finds every slot in flight is skipped rather than waited for
+struct ReadbackRing{
+  std::vector<ReadbackSlot> slots;
+  size_t slotSize; // Bytes, the largest image a slot takes
+  int first;       // Oldest slot in flight
+  int inFlight;
+
+  int completed;
+  int skipped;
+  int failed;         // Fence waits that failed, the slot is dropped
+  long latencyFrames; // Summed over the completed readbacks
+};
+
+// Encodes read back images to PNG files on a worker thread. Images that
+// arrive while maxQueued are still waiting are dropped
+struct PngWriter{
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<ReadbackImage> queued;
+  int maxQueued;
+  bool stopping;
+
+  int written;
+  int dropped;
+};
+
+
+void createReadbackRing(ReadbackRing* ring, int slots, size_t slotSize);
+
+// Queues a copy of layer of texture, a cube map face for cube maps. False
+// when it was skipped
+bool requestReadback(ReadbackRing* ring, unsigned int texture, int layer,
+		     int width, int height, std::string name, int frame);
+
+// Moves the finished readbacks into images, never waiting for the GPU
+void pollReadbacks(ReadbackRing* ring, int frame, std::vector<ReadbackImage>* images);
+
+// Writes image to its name, flipping its rows in place
+bool encodePng(ReadbackImage* image);
+
+void startPngWriter(PngWriter* writer, int maxQueued);
+
+// Takes the pixels of image
+void writePng(PngWriter* writer, ReadbackImage* image);
+
+// Writes what is still queued, then stops the worker
+void stopPngWriter(PngWriter* writer);
+
+void printReadbackStats(const ReadbackRing& ring, PngWriter* writer);
+
+
+#endif
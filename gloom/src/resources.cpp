@@ -0,0 +1,289 @@
+#include "resources.hpp"
+
+#include "gloom/utilities.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+
+unsigned int createBuffer(size_t size, const void* data, GLbitfield flags){
+  unsigned int buffer;
+  glCreateBuffers(1, &buffer);
+  glNamedBufferStorage(buffer, std::max<size_t>(size, 1), data, flags);
+  return buffer;
+}
+
+void createStreamBuffer(StreamBuffer* stream, size_t capacity){
+  stream->capacity = std::max<size_t>(capacity, 1);
+  stream->buffer = createBuffer(stream->capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+}
+
+bool uploadStreamBuffer(StreamBuffer* stream, const void* data, size_t size){
+  bool recreated = false;
+  if(size > stream->capacity){
+    glDeleteBuffers(1, &stream->buffer);
+    createStreamBuffer(stream, std::max(size, 2 * stream->capacity));
+    recreated = true;
+  }
+
+  if(size > 0){
+    glNamedBufferSubData(stream->buffer, 0, size, data);
+  }
+  return recreated;
+}
+
+unsigned int createVAO(int numArrays, int numElems, float** arrays, int* sizes, int numIndices, unsigned int* indices){
+  unsigned int vao;
+  glCreateVertexArrays(1, &vao);
+
+  const int maxvbos = 16;
+  if(numArrays > maxvbos){
+    printf("Too many arrays sent to createVAO (sent %d, max is %d)\n", numArrays, maxvbos);
+    exit(-1);
+  }
+
+  for(int i = 0; i < numArrays; i++){
+    unsigned int vbo = createBuffer(sizes[i] * numElems * sizeof(float), arrays[i]);
+
+    glVertexArrayVertexBuffer(vao, i, vbo, 0, sizes[i] * sizeof(float));
+    glVertexArrayAttribFormat(vao, i, sizes[i], GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(vao, i, i);
+    glEnableVertexArrayAttrib(vao, i);
+  }
+
+  unsigned int indexBuffer = createBuffer(numIndices * sizeof(unsigned int), indices);
+  glVertexArrayElementBuffer(vao, indexBuffer);
+
+  return vao;
+}
+
+unsigned int createVAOPosAndTex(int numElems, float* vertices, float* coords, int numIndices, unsigned int* indices){
+  float* arrays[] = {vertices, coords};
+  int sizes[] = {3, 2};
+  return createVAO(2, numElems, arrays, sizes, numIndices, indices);
+}
+
+unsigned int createVAOPosTexNormal(int numElems, float* vertices, float* coords, float* normals, int numIndices, unsigned int* indices){
+  float* arrays[] = {vertices, coords, normals};
+  int sizes[] = {3, 2, 3};
+  return createVAO(3, numElems, arrays, sizes, numIndices, indices);
+}
+
+// IEEE half float, rounded to nearest even. The bits of the float are
+// copied out rather than read through a cast, which breaks strict aliasing
+static uint16_t packHalf(float value){
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+
+  if(magnitude >= 0x7f800000){
+    // Infinity, or NaN kept quiet
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+  if(magnitude >= 0x477ff000){
+    // Rounds past 65504, the largest half
+    return sign | 0x7c00;
+  }
+  if(magnitude < 0x38800000){
+    // Below 2^-14, a subnormal half in steps of 2^-24
+    if(magnitude < 0x33000000){
+      return sign;
+    }
+    int shift = 126 - (int)(magnitude >> 23);
+    uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if(rest > halfway || (rest == halfway && (half & 1))){
+      half++;
+    }
+    return sign | half;
+  }
+
+  // Rebias the exponent from 127 to 15 and drop 13 bits of mantissa. A
+  // carry out of the mantissa correctly bumps the exponent
+  uint32_t half = (magnitude - 0x38000000) >> 13;
+  uint32_t rest = magnitude & 0x1fff;
+  if(rest > 0x1000 || (rest == 0x1000 && (half & 1))){
+    half++;
+  }
+  return sign | half;
+}
+
+// Signed normalized, in the low bits of the result
+static uint32_t packSnorm(float value, int bits){
+  float scale = (float)((1 << (bits - 1)) - 1);
+  int32_t n = (int32_t)std::round(glm::clamp(value, -1.0f, 1.0f) * scale);
+  return (uint32_t)n & ((1u << bits) - 1);
+}
+
+// GL_INT_2_10_10_10_REV, x in the lowest bits
+static uint32_t packSnorm2_10_10_10(const glm::vec4& value){
+  return packSnorm(value.x, 10) | packSnorm(value.y, 10) << 10
+    | packSnorm(value.z, 10) << 20 | packSnorm(value.w, 2) << 30;
+}
+
+unsigned int createPackedVAO(int numVertices, const float* vertices, const float* uvs,
+			     const float* normals, const float* tangents, const float* bitangents,
+			     int numIndices, const unsigned int* indices){
+  std::vector<PackedVertex> packed(numVertices);
+  for(int i = 0; i < numVertices; i++){
+    glm::vec3 normal(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+    glm::vec3 tangent(tangents[3 * i], tangents[3 * i + 1], tangents[3 * i + 2]);
+    glm::vec3 bitangent(bitangents[3 * i], bitangents[3 * i + 1], bitangents[3 * i + 2]);
+    float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+
+    for(int j = 0; j < 3; j++){
+      packed[i].position[j] = vertices[3 * i + j];
+    }
+    packed[i].uv[0] = packHalf(uvs[2 * i]);
+    packed[i].uv[1] = packHalf(uvs[2 * i + 1]);
+    packed[i].normal = packSnorm2_10_10_10(glm::vec4(normal, 0.0f));
+    packed[i].tangent = packSnorm2_10_10_10(glm::vec4(tangent, sign));
+  }
+
+  unsigned int vao;
+  glCreateVertexArrays(1, &vao);
+
+  unsigned int vbo = createBuffer(packed.size() * sizeof(PackedVertex), packed.data());
+  glVertexArrayVertexBuffer(vao, 0, vbo, 0, sizeof(PackedVertex));
+
+  glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position));
+  glVertexArrayAttribFormat(vao, 1, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, uv));
+  glVertexArrayAttribFormat(vao, 2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, normal));
+  glVertexArrayAttribFormat(vao, 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, tangent));
+
+  for(int i = 0; i < 4; i++){
+    glVertexArrayAttribBinding(vao, i, 0);
+    glEnableVertexArrayAttrib(vao, i);
+  }
+
+  unsigned int indexBuffer = createBuffer(numIndices * sizeof(unsigned int), indices);
+  glVertexArrayElementBuffer(vao, indexBuffer);
+
+  return vao;
+}
+
+int mipLevelCount(int size){
+  int levels = 1;
+  while(size > 1){
+    size /= 2;
+    levels++;
+  }
+  return levels;
+}
+
+unsigned int createTexture(std::string filename, unsigned int* width, unsigned int* height){
+  PNGImage image = loadPNGFile(filename);
+
+  unsigned int texture;
+  glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+
+  glTextureStorage2D(texture, mipLevelCount(std::max(image.width, image.height)), GL_RGBA8,
+		     image.width, image.height);
+  glTextureSubImage2D(texture, 0, 0, 0, image.width, image.height,
+		      GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, image.pixels.data());
+  glGenerateTextureMipmap(texture);
+
+  glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+  glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  if(width != 0){
+    *width = image.width;
+  }
+  
+  if(height != 0){
+    *height = image.height;
+  }
+  
+  return texture;
+}
+
+unsigned int createCubeMapTexture(int size, std::string* textureFile){
+  unsigned int textureID;
+  glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+
+  glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  
+  if(textureFile){
+    PNGImage image = loadPNGFile(*textureFile);
+    if(image.height != image.width){
+      puts((std::string("Texture ") + *textureFile + std::string(" did not have equal width and height, which are required for cubemap\n")).c_str());
+    }
+
+    glTextureStorage2D(textureID, 1, GL_RGBA8, image.width, image.width);
+
+    // Faces are the layers of a cube map with direct state access
+    for(int i = 0; i < 6; i++){
+      glTextureSubImage3D(textureID, 0, 0, 0, i, image.width, image.width, 1,
+			  GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, image.pixels.data());
+    }
+  }else{
+    glTextureStorage2D(textureID, 1, GL_RGBA8, size, size);
+  }
+
+  return textureID;
+}
+
+unsigned int createFramebuffer(int width, int height){
+  unsigned int framebuffer;
+  glCreateFramebuffers(1, &framebuffer);
+
+  unsigned int depthbuffer;
+  glCreateRenderbuffers(1, &depthbuffer);
+  glNamedRenderbufferStorage(depthbuffer, GL_DEPTH_COMPONENT24, width, height);
+  glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
+  
+  return framebuffer;
+}
+
+void createCubeFrameBuffer(int size, unsigned int* framebuffer, unsigned int* colorTexture){
+  glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, colorTexture);
+  glTextureParameteri(*colorTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTextureParameteri(*colorTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(*colorTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(*colorTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(*colorTexture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  // Full mip chain, filled in after each capture. Sized format so the
+  // levels can be written as images when prefiltering
+  glTextureStorage2D(*colorTexture, mipLevelCount(size), GL_RGBA8, size, size);
+
+  *framebuffer = createFramebuffer(size, size);
+
+  glNamedFramebufferTextureLayer(*framebuffer, GL_COLOR_ATTACHMENT0, *colorTexture, 0, 0);
+
+  if(glCheckNamedFramebufferStatus(*framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+    printf("Incomplete framebuffer!\n");
+    exit(-1);
+  }
+}
+
+// Layered rendering needs a layered depth attachment as well, so depth is
+// stored in a cube map instead of a renderbuffer
+void createLayeredCubeFrameBuffer(int size, unsigned int colorTexture,
+				  unsigned int* framebuffer, unsigned int* depthTexture){
+  glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, depthTexture);
+  glTextureParameteri(*depthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTextureParameteri(*depthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTextureStorage2D(*depthTexture, 1, GL_DEPTH_COMPONENT24, size, size);
+
+  glCreateFramebuffers(1, framebuffer);
+  glNamedFramebufferTexture(*framebuffer, GL_COLOR_ATTACHMENT0, colorTexture, 0);
+  glNamedFramebufferTexture(*framebuffer, GL_DEPTH_ATTACHMENT, *depthTexture, 0);
+
+  if(glCheckNamedFramebufferStatus(*framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+    printf("Incomplete layered framebuffer!\n");
+    exit(-1);
+  }
+}
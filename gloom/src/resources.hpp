@@ -0,0 +1,74 @@
+#ifndef RESOURCES_HPP
+#define RESOURCES_HPP
+#pragma once
+
+// Creation of GL buffers, vertex arrays, textures and framebuffers. Everything
+// uses direct state access and immutable storage, and nothing is left bound
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Compact interleaved vertex, 24 bytes instead of 56 for separate float
+// arrays. The bitangent is rebuilt in the shaders as
+// tangent.w * cross(normal, tangent)
+struct PackedVertex{
+  float position[3];
+  uint16_t uv[2];     // Half floats
+  uint32_t normal;    // Signed normalized 10_10_10_2
+  uint32_t tangent;   // Signed normalized 10_10_10_2, bitangent sign in w
+};
+
+// A buffer that is rewritten every frame. Immutable storage cannot be
+// resized, so the buffer is recreated, twice as large, when it runs out
+struct StreamBuffer{
+  unsigned int buffer;
+  size_t capacity;
+};
+
+
+// Buffer with immutable storage. flags are glNamedBufferStorage flags
+unsigned int createBuffer(size_t size, const void* data, GLbitfield flags = 0);
+
+void createStreamBuffer(StreamBuffer* stream, size_t capacity);
+
+// Uploads size bytes to the start of the buffer. Returns true if the
+// buffer had to be recreated, in which case it must be bound again
+bool uploadStreamBuffer(StreamBuffer* stream, const void* data, size_t size);
+
+// Vertex array with one tightly packed float buffer per attribute, attribute
+// i read from binding i
+unsigned int createVAO(int numArrays, int numElems, float** arrays, int* sizes, int numIndices, unsigned int* indices);
+
+unsigned int createVAOPosAndTex(int numElems, float* vertices, float* coords, int numIndices, unsigned int* indices);
+
+unsigned int createVAOPosTexNormal(int numElems, float* vertices, float* coords, float* normals, int numIndices, unsigned int* indices);
+
+// Vertex array with all attributes interleaved as PackedVertex in binding 0
+unsigned int createPackedVAO(int numVertices, const float* vertices, const float* uvs,
+			     const float* normals, const float* tangents, const float* bitangents,
+			     int numIndices, const unsigned int* indices);
+
+int mipLevelCount(int size);
+
+unsigned int createTexture(std::string filename, unsigned int* width = 0, unsigned int* height = 0);
+
+// If textureFile is non-zero, size is ignored
+unsigned int createCubeMapTexture(int size, std::string* textureFile = 0);
+
+// Framebuffer with a depth renderbuffer and no colour attachment
+unsigned int createFramebuffer(int width, int height);
+
+// Cube map with a full mip chain, and a framebuffer rendering to one face at
+// a time (face 0 is attached initially)
+void createCubeFrameBuffer(int size, unsigned int* framebuffer, unsigned int* colorTexture);
+
+// Creates a framebuffer that renders to all six faces of colorTexture at once
+void createLayeredCubeFrameBuffer(int size, unsigned int colorTexture,
+				  unsigned int* framebuffer, unsigned int* depthTexture);
+
+
+#endif
@@ -0,0 +1,43 @@
+#include "sphere_surface.hpp"
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <vector>
+
+
+SurfacePoint sphereSurfacePoint(float u, float v, float radius){
+  float horizontalAngle = 2 * M_PI * u;
+  float verticalAngle = M_PI * v - M_PI / 2;
+  float ch = cos(verticalAngle);
+
+  SurfacePoint point;
+  point.normal = glm::vec3(ch * sin(horizontalAngle), sin(verticalAngle), ch * cos(horizontalAngle));
+  point.position = radius * point.normal;
+  point.tangent = glm::vec3(cos(horizontalAngle), 0, -sin(horizontalAngle));
+  point.bitangent = glm::cross(point.normal, point.tangent);
+  return point;
+}
+
+unsigned int createSphereSurfaceTexture(int size, float radius){
+  std::vector<glm::vec4> layers(3 * size * size);
+  for(int y = 0; y < size; y++){
+    for(int x = 0; x < size; x++){
+      SurfacePoint point = sphereSurfacePoint((x + 0.5f) / size, (y + 0.5f) / size, radius);
+      int texel = y * size + x;
+      layers[surfacePositionLayer * size * size + texel] = glm::vec4(point.position, 1.0f);
+      layers[surfaceTangentLayer * size * size + texel] = glm::vec4(point.tangent, 0.0f);
+      layers[surfaceBitangentLayer * size * size + texel] = glm::vec4(point.bitangent, 0.0f);
+    }
+  }
+
+  unsigned int texture;
+  glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+  glTextureStorage3D(texture, 1, GL_RGBA32F, size, size, 3);
+  glTextureSubImage3D(texture, 0, 0, 0, 0, size, size, 3, GL_RGBA, GL_FLOAT, layers.data());
+  glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT); // Around the u = 0 seam
+  glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
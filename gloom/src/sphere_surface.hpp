@@ -0,0 +1,33 @@
+#ifndef SPHERE_SURFACE_HPP
+#define SPHERE_SURFACE_HPP
+#pragma once
+
+// The uv parametrization of the sphere, shared by createSphereObject and the
+// per-texel surface data the dent shaders read instead of the mesh
+
+#include "glm/glm.hpp"
+
+
+// Layers of the surface texture
+const int surfacePositionLayer = 0;
+const int surfaceTangentLayer = 1;
+const int surfaceBitangentLayer = 2;
+
+struct SurfacePoint{
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec3 tangent;   // Along u
+  glm::vec3 bitangent; // Along v
+};
+
+
+// u goes once around from +z towards +x, v from the bottom pole to the top
+SurfacePoint sphereSurfacePoint(float u, float v, float radius);
+
+// Bakes the surface at every texel centre of a size x size atlas into the
+// layers of an RGBA32F array texture. It is filtered, so it can also be
+// sampled for a finer atlas
+unsigned int createSphereSurfaceTexture(int size, float radius);
+
+
+#endif